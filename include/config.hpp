@@ -3,6 +3,8 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
 
+#include <string>
+
 namespace config
 {
     class config
@@ -11,6 +13,24 @@ namespace config
             vk::PresentModeKHR preferredPresentMode = vk::PresentModeKHR::eFifoRelaxed; //aka VSync
             vk::SampleCountFlagBits sampleCount = vk::SampleCountFlagBits::e2; // aka Anti-aliasing
             uint32_t shadowResolution = 2048;
+            int shadowFilterRadius = 2; // PCF kernel of (2r+1)x(2r+1) samples, 0 for a single sample
+            int shadowCascades = 4; // per directional light, at most 4
+            float shadowDistance = 50.0f; // from the camera, directional lights cast no shadows further away
+            int shadowUpdateBudget = 0; // outdated shadow map layers redrawn per frame in round robin, 0 for all of them
+            bool gpuCulling = true; // cull and build the draw commands in a compute shader, falls back to the CPU if unsupported
+            bool depthPrepass = false; // draw only the depth of the main pass first, so render.frag runs once per pixel at the cost of a second geometry pass
+            bool dynamicResolution = true; // lowers the resolution of the main and shading passes while the GPU needs longer than frameTimeBudget
+            float frameTimeBudget = 14.0f; // milliseconds of GPU time per frame
+            float minResolutionScale = 0.5f; // of the window size, per axis
+            bool gpuStatistics = false; // count the shader invocations of every pass for the HUD, may slow down the GPU
+            bool tiledLighting = true; // shade every pixel once in a compute shader with the lights of its tile, instead of a fullscreen pass per light
+            int framesInFlight = 2; // recorded while the GPU is still busy with earlier ones, 1 for the lowest latency at the cost of throughput
+            double frameRateLimit = 0.0; // in frames per second, 0 for no limit, saves power if the GPU could render faster
+            int recordingThreads = 0; // for secondary command buffers, 0 for one less than the number of cores
+
+            std::string fontFile = "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf";
+            std::string pipelineCacheFile = "pipeline_cache.bin"; // empty to disable
+            std::string loaderStatisticsFile = "loader_statistics.json"; // written at shutdown, empty to disable
     };
     inline class config CONFIG;
 }
@@ -6,10 +6,12 @@ namespace entity::components
 {
     struct light
     {
-        glm::vec3 direction;
+        glm::vec3 direction; // towards the light
         glm::vec3 color = glm::vec3(1.0, 1.0, 1.0);
         float zNear = 1.0f;
         float zFar = 10.0f;
         bool castShadow = true;
+        bool directional = false; // lit from direction everywhere with cascaded shadows, position and zNear/zFar are unused
+        float radius = 0.0f; // beyond which the light has no effect, 0 for no limit
     };
 }
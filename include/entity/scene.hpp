@@ -0,0 +1,24 @@
+#pragma once
+
+#include "entity/id.hpp"
+
+#include <entt/entity/registry.hpp>
+#include <entt/core/hashed_string.hpp>
+
+#include <map>
+#include <string>
+
+namespace entity
+{
+    // stored in the registry context, maps the hashes in components back to the asset files they name
+    struct asset_names
+    {
+        std::map<entt::hashed_string::hash_type, std::string> names;
+
+        entt::hashed_string::hash_type add(const std::string& name);
+        const std::string* find(entt::hashed_string::hash_type hash) const;
+    };
+
+    // creates all entities of a scene manifest, returns them by the name given in the manifest
+    std::map<std::string, entity_id> load_scene(entt::registry& registry, const std::string& filename);
+}
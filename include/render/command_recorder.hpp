@@ -0,0 +1,58 @@
+#pragma once
+
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#include <vulkan/vulkan.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace render
+{
+    // records secondary command buffers on worker threads, each with its own command pool per frame
+    class command_recorder
+    {
+        public:
+            using job = std::function<void(vk::CommandBuffer)>;
+
+            command_recorder(vk::Device device, uint32_t queueFamily, int frameCount, int threadCount);
+            ~command_recorder();
+
+            // resets all buffers recorded for this frame, which must not be in use by the GPU anymore
+            void begin_frame(int frame);
+            // the buffer is begun for use inside the render pass of the inheritance info and ended after the job ran
+            std::future<vk::CommandBuffer> record(int frame, vk::CommandBufferInheritanceInfo inheritance, job fn);
+
+            int thread_count() const { return threads.size(); }
+        private:
+            struct task
+            {
+                int frame;
+                vk::CommandBufferInheritanceInfo inheritance;
+                job fn;
+                std::promise<vk::CommandBuffer> promise;
+            };
+            struct frame_pool
+            {
+                vk::UniqueCommandPool pool;
+                std::vector<vk::CommandBuffer> buffers;
+                size_t used = 0;
+            };
+
+            vk::Device device;
+
+            std::vector<std::vector<frame_pool>> pools; // [thread][frame]
+
+            std::mutex lock;
+            std::vector<std::thread> threads;
+            std::queue<task> tasks;
+            std::condition_variable cv;
+            bool quit = false;
+
+            void recordThread(int index);
+    };
+}
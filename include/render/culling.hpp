@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace render::culling
+{
+    struct frustum
+    {
+        std::array<glm::vec4, 6> planes; // xyz: normal pointing inwards, w: distance
+
+        static frustum from_matrix(const glm::mat4& viewProjection);
+    };
+
+    // world space bounding boxes, one array per coordinate so that four boxes can be tested at once
+    struct aabb_list
+    {
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+
+        size_t size() const { return minX.size(); }
+        void clear();
+        // bounds of the model space box [min, max] after the transformation
+        void push_back(const glm::mat4& transform, glm::vec3 min, glm::vec3 max);
+    };
+
+    // sets visible[i] for every box that is at least partially inside the frustum and returns how many are
+    size_t cull(const frustum& f, const aabb_list& boxes, std::vector<uint8_t>& visible);
+}
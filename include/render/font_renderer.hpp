@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <map>
@@ -27,8 +28,8 @@ namespace render
             font_renderer(std::string name, int size, vk::Device device, vma::Allocator allocator);
             ~font_renderer();
 
-            void preload(FT_Library ft, resource_loader* loader, vk::RenderPass renderPass);
-            void prepare(int imageCount);
+            void preload(FT_Library ft, resource_loader* loader, vk::RenderPass renderPass, vk::PipelineCache pipelineCache = {});
+            void prepare(int frameCount);
             void renderText(vk::CommandBuffer cmd, int frame, std::string_view text, float x, float y, float scale = 1.0f, glm::vec4 color = glm::vec4(1.0, 1.0, 1.0, 1.0));
             void finish(int frame);
 
@@ -38,6 +39,7 @@ namespace render
 
             vk::UniquePipelineLayout pipelineLayout;
             vk::UniquePipeline pipeline;
+            std::chrono::nanoseconds pipelineTime{};
 
             vk::UniqueDescriptorSetLayout descriptorLayout;
             vk::UniqueDescriptorPool descriptorPool;
@@ -0,0 +1,88 @@
+#pragma once
+
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace render
+{
+    // times labeled scopes of a primary command buffer with timestamp queries and optionally counts their shader invocations,
+    // the results of a frame are read without waiting when the same frame is begun again and smoothed over time
+    class gpu_profiler
+    {
+        public:
+            struct scope_result
+            {
+                std::string name;
+                int depth = 0; // of nesting, the whole frame is 0
+                float time = 0.0f; // in milliseconds, smoothed
+                float lastTime = 0.0f; // in milliseconds, from the latest frame read back
+                // only counted for scopes directly inside the frame and with statistics enabled, smoothed
+                double vertexInvocations = 0.0;
+                double fragmentInvocations = 0.0;
+                double computeInvocations = 0.0;
+            };
+
+            // statistics are only counted if requested and supported, everything is disabled without timestamps on the queue
+            gpu_profiler(vk::PhysicalDevice physicalDevice, vk::Device device, const vk::PhysicalDeviceFeatures& enabledFeatures,
+                uint32_t queueFamily, int frameCount, bool statistics);
+
+            bool enabled() const { return timestampPeriod > 0.0f; }
+            bool has_statistics() const { return bool(statisticsPool); }
+
+            // reads the last results of this frame if they are available, resets its queries and opens the frame scope,
+            // the command buffer must be outside of a render pass, returns whether new results were read
+            bool begin_frame(vk::CommandBuffer commandBuffer, int frame);
+            void end_frame(vk::CommandBuffer commandBuffer);
+
+            // also opens a debug label, the name must outlive the results of the frame (a string literal),
+            // scopes with statistics must begin and end outside of a render pass
+            void begin_scope(vk::CommandBuffer commandBuffer, const char* name);
+            void end_scope(vk::CommandBuffer commandBuffer);
+
+            // for the inheritance info of secondary command buffers executed inside a scope
+            vk::QueryPipelineStatisticFlags inherited_statistics() const { return has_statistics() ? statisticFlags : vk::QueryPipelineStatisticFlags{}; }
+
+            // in the order of the latest frame read back, the first one is the whole frame
+            const std::vector<scope_result>& results() const { return scopeResults; }
+            const scope_result* find(std::string_view name) const;
+        private:
+            static constexpr uint32_t maxScopes = 32; // per frame, including the frame itself
+            static constexpr float smoothing = 0.1f; // weight of a new measurement
+            static constexpr vk::QueryPipelineStatisticFlags statisticFlags =
+                vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+                vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+            static constexpr uint32_t statisticCount = 3; // bits in statisticFlags, results are written in the order of the bits
+
+            struct recorded_scope
+            {
+                const char* name;
+                int depth;
+                int statistics; // query index relative to the frame, -1 if not counted
+            };
+            struct frame_queries
+            {
+                std::vector<recorded_scope> scopes; // timestamps 2*i and 2*i+1 relative to the frame
+                uint32_t statisticsUsed = 0;
+                bool written = false;
+            };
+
+            vk::Device device;
+            vk::UniqueQueryPool timestampPool;
+            vk::UniqueQueryPool statisticsPool;
+            float timestampPeriod = 0.0f; // nanoseconds per tick, 0 if the queue has no timestamps
+            uint64_t timestampMask = 0; // of the valid bits
+
+            std::vector<frame_queries> frames;
+            int currentFrame = 0;
+            std::vector<uint32_t> openScopes; // indices into the scopes of the current frame
+
+            std::vector<scope_result> scopeResults;
+
+            bool read_results(int frame);
+    };
+}
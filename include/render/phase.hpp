@@ -6,6 +6,9 @@
 
 #include "render/resource_loader.hpp"
 
+#include <chrono>
+#include <mutex>
+
 namespace render
 {
     class window;
@@ -19,11 +22,14 @@ namespace render
             virtual void preload();
             virtual void prepare(std::vector<vk::Image> swapchainImages, std::vector<vk::ImageView> swapchainViews);
             virtual void init();
-            virtual void render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence);
+            // frame is the slot of the frame in flight, image the swapchain image it ends up in
+            virtual void render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence);
 
             void waitLoad();
+            bool isLoaded() const;
 
             const vma::Allocator& get_allocator() const { return allocator; }
+            std::chrono::nanoseconds getPipelineTime() const { return pipelineTime; }
         protected:
             window* win;
 
@@ -34,7 +40,14 @@ namespace render
 
             uint32_t graphicsFamily;
             vk::Queue graphicsQueue;
+            std::mutex* queueMutex; // of the window, held while submitting to graphicsQueue
 
             std::vector<std::shared_future<void>> loadingFutures;
+
+            vk::PipelineCache pipelineCache;
+            std::chrono::nanoseconds pipelineTime{}; // spent creating pipelines, for comparing cold and warm starts
+            vk::UniquePipeline createPipeline(const vk::GraphicsPipelineCreateInfo& info);
+            std::vector<vk::UniquePipeline> createPipelines(vk::ArrayProxy<const vk::GraphicsPipelineCreateInfo> infos);
+            vk::UniquePipeline createPipeline(const vk::ComputePipelineCreateInfo& info);
     };
 }
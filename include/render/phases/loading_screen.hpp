@@ -11,7 +11,7 @@ namespace render::phases
             loading_screen(window* window);
             void preload() override;
             void prepare(std::vector<vk::Image> swapchainImages, std::vector<vk::ImageView> swapchainViews) override;
-            void render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence) override;
+            void render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence) override;
 
             struct LoadingPoint
             {
@@ -20,11 +20,19 @@ namespace render::phases
                 bool done = false;
             };
             void submitLoadingPoint(LoadingPoint p);
+
+            // forget all loading points and measure loader progress from now on
+            void reset();
         private:
             std::unique_ptr<texture> background;
+            std::shared_future<void> backgroundReady;
+            vk::UniqueSampler sampler;
             std::unique_ptr<font_renderer> font;
 
             vk::UniqueRenderPass renderPass;
+            vk::UniqueDescriptorSetLayout descriptorLayout;
+            vk::UniqueDescriptorPool descriptorPool;
+            vk::DescriptorSet descriptorSet;
             vk::UniquePipelineLayout pipelineLayout;
             vk::UniquePipeline pipeline;
 
@@ -35,5 +43,11 @@ namespace render::phases
             std::vector<vk::UniqueCommandBuffer> commandBuffers;
 
             std::vector<LoadingPoint> loadingPoints;
+            LoaderProgress baseline;
+
+            struct PushConstants
+            {
+                float progress;
+            };
     };
 }
@@ -5,15 +5,22 @@
 #include "render/texture.hpp"
 #include "render/model.hpp"
 #include "render/font_renderer.hpp"
+#include "render/culling.hpp"
+#include "render/command_recorder.hpp"
+#include "render/gpu_profiler.hpp"
 
 #include "entity/components/light.hpp"
 #include "entity/components/position.hpp"
 #include "entity/components/model.hpp"
 #include "entity/components/camera.hpp"
 #include "entity/components/collision.hpp"
+#include "entity/components/renderable.hpp"
 
 #include <entt/entt.hpp>
 #include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace entt::literals;
 
@@ -21,13 +28,6 @@ namespace render::phases
 {
     class render_test : public phase
     {
-        static constexpr std::array<entt::hashed_string, 4> load_models = {
-            "plane.obj"_hs, "soraka.obj"_hs, "monkey.obj"_hs, "cube.obj"_hs
-        };
-        static constexpr std::array<entt::hashed_string, 3> load_textures = {
-            "soraka.png"_hs, "ground.png"_hs, "gray.png"_hs
-        };
-
         public:
             render_test(window* window, entt::registry& entities, std::function<void(gui_render_context&)> guiRenderCallback = {});
             ~render_test();
@@ -35,19 +35,56 @@ namespace render::phases
             void preload() override;
             void prepare(std::vector<vk::Image> swapchainImages, std::vector<vk::ImageView> swapchainViews) override;
             void init() override;
-            void render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence) override;
+            void render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence) override;
 
             void set_camera(entity::entity_id entity);
+
+            struct cull_statistics
+            {
+                uint32_t mainVisible = 0;
+                uint32_t mainTotal = 0;
+                uint32_t shadowVisible = 0;
+                uint32_t shadowTotal = 0; // summed over all shadow maps
+                uint32_t shadowLayersDrawn = 0;
+                uint32_t shadowLayers = 0; // in use, the others are still valid from an earlier frame
+            };
+            const cull_statistics& get_cull_statistics() const { return cullStatistics; }
+            // GPU time of the main pass including the depth pre-pass in milliseconds, smoothed over the last frames
+            float get_main_pass_time() const { return mainPassTime; }
+            float get_frame_time() const { return frameTime; } // GPU time of the whole frame in milliseconds
+            const gpu_profiler& get_profiler() const { return *profiler; } // times every labeled scope of the frame
+            float get_resolution_scale() const { return resolutionScale; }
         private:
-            std::vector<std::vector<std::unique_ptr<texture>>> shadowBuffers;
+            static constexpr int maxLights = 8; // drawn one fullscreen pass each
+            static constexpr int maxTiledLights = 1024; // with tiled lighting, of which at most maxTileLights reach each tile
+            static constexpr uint32_t maxTileLights = 256; // matches light.comp
+            static constexpr uint32_t lightTileSize = 16; // in pixels, the workgroup size of light.comp
+            static constexpr uint32_t maxShadowLayers = 8; // point lights take one layer, directional lights one per cascade
+            static constexpr int maxCascades = 4;
+            static constexpr float cascadeSplitLambda = 0.75f; // 0 for uniform, 1 for logarithmic cascade splits
+            static constexpr uint32_t initialObjects = 2048; // per frame, the object buffers of a frame grow when it has more
+            static constexpr uint32_t maxTextures = 4096; // lowered to what the device supports
+            // the main pass draws the camera view, the shadow pass the views of all shadow casting lights into one layered image
+            static constexpr uint32_t mainPass = 0;
+            static constexpr uint32_t shadowPass = 1;
+            static constexpr uint32_t passCount = 2;
+            static constexpr uint32_t viewCount = maxShadowLayers+1;
+            static constexpr uint32_t layerShift = 24; // instance buffer entries are the model slot with the shadow map layer above
+            static constexpr uint32_t maxObjects = 1 << layerShift;
+            static constexpr size_t minSliceBatches = 16; // per secondary command buffer of the main pass
+
+            std::vector<std::unique_ptr<texture>> shadowBuffers; // one layer per light or cascade
             vk::UniqueSampler shadowSampler;
 
+            // G-buffer: albedo, octahedral normal and depth, the shading pass reconstructs positions from the depth
             std::vector<std::unique_ptr<texture>> colorBuffers;
             std::vector<std::unique_ptr<texture>> shadeBuffers;
             std::vector<std::unique_ptr<texture>> depthBuffers;
+            vk::Format normalFormat; // RG16 integer, see preload()
 
             std::vector<std::unique_ptr<texture>> colorRevolveBuffers;
             std::vector<std::unique_ptr<texture>> shadeRevolveBuffers;
+            std::vector<std::unique_ptr<texture>> depthRevolveBuffers; // sample zero of every pixel
 
             vk::UniqueRenderPass shadowRenderPass;
             vk::UniqueRenderPass mainRenderPass;
@@ -64,11 +101,14 @@ namespace render::phases
             std::vector<vk::DescriptorSet> shadeDescriptorSets;
 
             vk::UniqueDescriptorSetLayout shadowMapDescriptorLayout;
-            std::vector<std::vector<vk::DescriptorSet>> shadowMapDescriptorSets;
+            std::vector<vk::DescriptorSet> shadowMapDescriptorSets;
 
+            // one array of all textures, indexed by ModelInfo::material.x
             vk::UniqueDescriptorPool textureDescriptorPool;
             vk::UniqueDescriptorSetLayout textureDescriptorLayout;
-            std::vector<vk::DescriptorSet> textureDescriptorSets;
+            vk::DescriptorSet textureDescriptorSet;
+            uint32_t textureSlotCount = 0; // slot 0 is the placeholder
+            uint32_t textureSlotLimit = 0;
 
             vk::UniqueSampler textureSampler;
 
@@ -76,24 +116,94 @@ namespace render::phases
             vk::UniquePipelineLayout mainPipelineLayout;
             vk::UniquePipelineLayout shadePipelineLayout;
             vk::UniquePipeline shadowPipeline;
-            vk::UniquePipeline mainPipeline;
+            bool shaderLayer = false; // shadow_layer.vert sets gl_Layer itself, otherwise shadow.geom does
+            vk::UniquePipeline mainPipeline; // tests for equal depth and does not write it with the depth pre-pass
+            bool depthPrepass = false; // CONFIG.depthPrepass
+            vk::UniquePipeline prepassPipeline;
             vk::UniquePipeline hitboxPipeline;
-            vk::UniquePipeline shadePipeline;
+            // shade.frag specialization, matches its constant_ids
+            struct ShadeVariant
+            {
+                int32_t pcfRadius;
+                vk::Bool32 shadows;
+            };
+            static constexpr int maxFilterRadius = 2;
+            std::array<std::array<vk::UniquePipeline, 2>, maxFilterRadius+1> shadePipelines; // [pcfRadius][shadows]
 
-            std::vector<vk::Image> swapchainImages;
-            std::vector<std::vector<vk::UniqueFramebuffer>> shadowFramebuffers;
+            // light.comp shades every pixel once into litBuffers, the shading pass then only copies that into the swapchain image
+            bool tiledLighting = false; // CONFIG.tiledLighting
+            std::vector<std::unique_ptr<texture>> litBuffers;
+            vk::UniqueSampler gbufferSampler; // the G-buffer is only read with texelFetch
+            vk::UniqueDescriptorSetLayout lightingDescriptorLayout;
+            std::vector<vk::DescriptorSet> lightingDescriptorSets;
+            vk::UniquePipelineLayout lightingPipelineLayout;
+            std::array<vk::UniquePipeline, maxFilterRadius+1> lightingPipelines; // [pcfRadius]
+            vk::UniquePipeline composePipeline;
+            vk::UniquePipeline ambientPipeline; // without tiled lighting, before the pass of every light
+            struct LightingPush
+            {
+                glm::mat4 globalInverse;
+                glm::uvec2 extent; // rendered part of the targets
+                uint32_t lightCount;
+            };
+            uint32_t lightCount = 0; // set up by update_views() in this frame
+
+            bool gpuCulling = false; // CONFIG.gpuCulling and supported by the device
+            bool drawIndirectCount = false;
+            vk::UniqueDescriptorSetLayout cullDescriptorLayout;
+            std::vector<vk::DescriptorSet> cullDescriptorSets;
+            vk::UniquePipelineLayout cullPipelineLayout;
+            vk::UniquePipeline cullPipeline;
+            // matches View in cull.comp, all views are culled by one dispatch
+            struct CullView
+            {
+                std::array<glm::vec4, 6> planes;
+                uint32_t commandOffset;
+                uint32_t statisticsIndex;
+                uint32_t layer;
+                vk::Bool32 shadowPass;
+            };
+            std::vector<vk::Buffer> cullViewBuffers;
+            std::vector<vma::Allocation> cullViewAllocations;
+            std::vector<CullView*> cullViewPointers;
+
+            std::vector<vk::UniqueFramebuffer> shadowFramebuffers;
             std::vector<vk::UniqueFramebuffer> mainFramebuffers;
             std::vector<vk::UniqueFramebuffer> shadeFramebuffers;
-            std::vector<vk::UniqueFramebuffer> overlayFramebuffers;
+            std::vector<vk::UniqueFramebuffer> overlayFramebuffers; // per swapchain image, everything else is per frame in flight
 
             vk::UniqueCommandPool pool;
             std::vector<vk::UniqueCommandBuffer> commandBuffers;
 
             std::unique_ptr<font_renderer> font;
 
-            std::vector<std::unique_ptr<texture>> textures;
-            std::map<entt::hashed_string::hash_type, vk::DescriptorSet> textureSets;
-            std::map<entt::hashed_string::hash_type, std::unique_ptr<model>> models;
+            struct texture_asset
+            {
+                std::unique_ptr<texture> tex;
+                uint32_t slot = 0;
+                std::shared_future<void> future;
+                bool ready = false;
+            };
+            struct model_asset
+            {
+                std::unique_ptr<model> mesh;
+                std::shared_future<void> future;
+                bool ready = false;
+            };
+            std::unordered_map<entt::hashed_string::hash_type, texture_asset> textures;
+            std::unordered_map<entt::hashed_string::hash_type, model_asset> models;
+            texture_asset placeholderTexture;
+
+            // registers the texture in the next free slot of the texture array, returns the placeholder slot if it is full
+            uint32_t allocate_texture_slot(const texture& tex);
+            void request_assets(entt::registry& registry, entity::entity_id e);
+            void request_model(entt::hashed_string::hash_type name);
+            void request_texture(entt::hashed_string::hash_type name);
+            const std::string* asset_file(entt::hashed_string::hash_type name);
+
+            void update_assets();
+            model* find_model(entt::hashed_string::hash_type name);
+            std::optional<uint32_t> find_texture(entt::hashed_string::hash_type name);
 
             struct GlobalInfo
             {
@@ -113,39 +223,196 @@ namespace render::phases
                 glm::mat4 transform;
                 glm::vec4 min;
                 glm::vec4 max;
+                glm::uvec4 material; // x: texture slot
+            };
+            std::vector<vk::Buffer> modelBuffers; // indexed by the slot in the instance buffer
+            std::vector<vma::Allocation> modelAllocations;
+            std::vector<ModelInfo*> modelPointers;
+
+            // entries of the model buffer of every frame, the instance, object and draw buffers are sized from it
+            std::vector<uint32_t> objectCapacity;
+            // creates the buffers that grow with the number of objects and points the descriptor sets of the frame at them
+            void allocate_object_buffers(int frame, uint32_t capacity);
+            void free_object_buffers(int frame);
+            // into the draw count buffer, one counter per view after the draw counts of all passes
+            uint32_t statistics_offset(int frame) const { return passCount*objectCapacity[frame]; }
+
+            enum render_flags : uint8_t
+            {
+                ShadowCaster = 1 << 0,
+                ShadowCatcher = 1 << 1,
+                Hitbox = 1 << 2
+            };
+            struct draw_batch
+            {
+                model* mesh;
+                uint32_t firstInstance; // into the instance buffer
+                uint32_t instanceCount;
+            };
+            // everything the passes need from the registry, packed once per frame by extract()
+            struct render_list
+            {
+                std::vector<entity::entity_id> entities;
+                std::vector<glm::mat4> transforms;
+                std::vector<model*> meshes;
+                std::vector<uint32_t> textures; // slots in the texture array
+                std::vector<uint8_t> flags;
+                culling::aabb_list bounds;
+                uint32_t casters = 0;
+                glm::vec3 casterMin, casterMax; // around all shadow casters
+
+                std::vector<uint32_t> order; // sorted by mesh, texture and shadow caster flag
+                std::vector<uint32_t> slots; // position of each entry in the model buffer
+
+                // before culling, for the compute pass: firstInstance is the first slot and instanceCount the number of entries
+                std::vector<draw_batch> mainBatches;
+                std::vector<draw_batch> shadowBatches;
+
+                size_t size() const { return entities.size(); }
+                void clear();
+            };
+            // rebuilt every frame, kept around to reuse their memory
+            render_list renderList;
+            void extract(int frame);
+
+            struct view
+            {
+                culling::frustum frustum;
+                uint32_t pass;
+                uint32_t layer; // in the shadow map array
+            };
+            std::vector<view> views; // the camera first, then every layer of the shadow map that is drawn
+            // camera, light and shadow matrices, needed before any pass is culled
+            void update_views(int frame);
+            std::array<entity::entity_id, maxShadowLayers> layerLights; // light each layer belongs to in this frame
+            uint32_t usedLayers = 0;
+
+            // what every layer of the shadow map of a frame was last drawn with, it is only drawn again if that changed
+            struct shadow_layer_cache
+            {
+                entity::entity_id light = entt::null;
+                GlobalInfo matrices;
+                bool valid = false; // cleared when a light or a caster the layer sees changed, the content can still be used
             };
-            std::vector<vk::Buffer> modelUniformBuffers;
-            std::vector<vma::Allocation> modelUniformAllocations;
-            std::vector<ModelInfo*> modelUniformPointers;
+            std::vector<std::array<shadow_layer_cache, maxShadowLayers>> shadowCache; // [frame][layer]
+            std::vector<bool> shadowMapsReady; // moved out of the undefined layout
+            uint32_t shadowRefreshCursor = 0; // where the next round robin refresh of stale layers starts
+
+            // entities whose position, rotation, light or renderable changed since the last frame,
+            // a set because entities are updated many times before the first frame drains it
+            std::unordered_set<entity::entity_id> changedEntities;
+            void mark_changed(entt::registry&, entity::entity_id e);
+            // where every shadow caster was when the shadow maps last saw it
+            std::unordered_map<entity::entity_id, std::pair<glm::vec3, glm::vec3>> casterBounds;
+            culling::aabb_list dirtyBounds;
+            // invalidates the layers affected by changes and adds a view for every layer that is drawn in this frame
+            void update_shadow_cache(int frame);
+            // fits one shadow layer per cascade around slices of the camera frustum, returns the depths the slices end at
+            glm::vec4 fit_cascades(int frame, const entity::components::target_camera& cam, glm::vec3 direction,
+                uint32_t firstLayer, int cascadeCount);
+
+            // CPU culling results, one per pass so that they can be built on different threads
+            struct pass_batches
+            {
+                std::vector<draw_batch> batches;
+                uint32_t drawn = 0;
+            };
+            std::array<pass_batches, passCount> passBatches;
+            std::array<std::vector<uint8_t>, viewCount> viewVisible;
+            // culls the render list against the views of the pass and fills its batches and part of the instance buffer
+            void build_batches(int frame, uint32_t pass);
+
+            // GPU culling of all views at once
+            void record_culling(vk::CommandBuffer commandBuffer, int frame);
+
+            // the batches a pass draws, depending on where it is culled
+            const std::vector<draw_batch>& batches_of(uint32_t pass) const;
+            void draw_batches(vk::CommandBuffer commandBuffer, int frame, uint32_t pass, size_t begin, size_t end);
+
+            // recorded into secondary command buffers on the recorder threads
+            std::unique_ptr<command_recorder> recorder;
+            void record_shadow(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end);
+            void record_prepass(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end);
+            void record_main(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end);
+            void record_hitboxes(vk::CommandBuffer commandBuffer, int frame);
+
+            std::vector<vk::Buffer> objectBuffers; // batch of every slot in the main and shadow passes
+            std::vector<vma::Allocation> objectAllocations;
+            std::vector<glm::uvec2*> objectPointers;
+
+            std::vector<vk::Buffer> drawCommandBuffers;
+            std::vector<vma::Allocation> drawCommandAllocations;
+            std::vector<vk::DrawIndexedIndirectCommand*> drawCommandPointers;
+
+            std::vector<vk::Buffer> drawCountBuffers;
+            std::vector<vma::Allocation> drawCountAllocations;
+            std::vector<uint32_t*> drawCountPointers;
+
+            std::vector<vk::Buffer> instanceBuffers;
+            std::vector<vma::Allocation> instanceAllocations;
+            std::vector<uint32_t*> instancePointers;
+
+            cull_statistics cullStatistics;
+
+            std::unique_ptr<gpu_profiler> profiler;
+            float mainPassTime = 0.0f;
+            float frameTime = 0.0f;
+
+            // dynamic resolution: the main and shading passes draw into the top left part of their targets,
+            // which the upscale pass stretches over the swapchain image
+            static constexpr vk::Format sceneFormat = vk::Format::eR16G16B16A16Sfloat;
+            float resolutionScale = 1.0f;
+            vk::Extent2D renderExtent; // of this frame
+            // moves the scale towards what fits into CONFIG.frameTimeBudget
+            void adapt_resolution(float measuredFrameTime);
+            std::vector<std::unique_ptr<texture>> sceneBuffers; // shaded, before upscaling
+            vk::UniqueSampler upscaleSampler;
+            vk::UniqueRenderPass upscalePass;
+            vk::UniqueDescriptorSetLayout upscaleDescriptorLayout;
+            std::vector<vk::DescriptorSet> upscaleDescriptorSets;
+            vk::UniquePipelineLayout upscalePipelineLayout;
+            vk::UniquePipeline upscalePipeline;
+            struct UpscalePush
+            {
+                glm::vec2 scale; // of the rendered part in texture coordinates
+                glm::vec2 limit; // half a texel inside of it, so that filtering does not reach outside
+            };
+            std::vector<vk::UniqueFramebuffer> upscaleFramebuffers; // per swapchain image
 
             struct LightInfo
             {
-                glm::vec4 position;
+                glm::vec4 position; // w = 0 for directional lights, xyz is the direction towards the light then
                 glm::vec4 direction;
-                glm::vec4 color;
+                glm::vec4 color; // w: radius, 0 if it reaches everywhere
 
-                glm::mat4 lightMatrix;
                 glm::mat4 globalInverse;
+                glm::vec4 cascadeSplits; // camera depth at which each cascade ends
+                glm::ivec4 shadow; // x: first layer in the shadow map array, y: number of layers, 0 without shadows
             };
+            // the largest minUniformBufferOffsetAlignment allowed, so every device accepts it as dynamic offset
+            static constexpr size_t lightInfoStride = 256;
+            static_assert(sizeof(LightInfo) <= lightInfoStride);
             std::vector<vk::Buffer> lightUniformBuffers;
             std::vector<vma::Allocation> lightUniformAllocations;
-            std::vector<LightInfo*> lightUniformPointers;
+            std::vector<uint8_t*> lightUniformPointers;
+            LightInfo& light_info(int frame, int light) { return *(LightInfo*)(lightUniformPointers[frame] + light*lightInfoStride); }
+            // the part of the screen the light can reach, empty if it is off screen
+            vk::Rect2D light_scissor(int frame, const LightInfo& info) const;
+            // all lights packed for tiled lighting, which needs no dynamic offsets
+            std::vector<vk::Buffer> lightStorageBuffers;
+            std::vector<vma::Allocation> lightStorageAllocations;
+            std::vector<LightInfo*> lightStoragePointers;
 
             entt::registry& entities;
             entity::entity_id camera;
             decltype(std::declval<entt::registry>().view<
                 const entity::components::position,
                 const entity::components::light>()) lightView;
-            decltype(std::declval<entt::registry>().view<
-                const entity::components::position,
-                const entity::components::model>()) modelView;
-            decltype(std::declval<entt::registry>().view<
-                const entity::components::position,
-                const entity::components::model,
-                entity::components::collision>()) hitboxView;
+            // owns its components, so they are packed at the front of their pools in the same order
+            decltype(std::declval<entt::registry>().group<
+                entity::components::position,
+                entity::components::model,
+                entity::components::renderable>()) renderGroup;
             std::function<void(gui_render_context&)> guiRenderCallback;
-
-            static constexpr int maxLights = 8;
-            static constexpr int maxObjects = 2048;
     };
 }
@@ -8,6 +8,8 @@
 #include <condition_variable>
 #include <optional>
 #include <future>
+#include <chrono>
+#include <ostream>
 
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
@@ -35,6 +37,62 @@ namespace render
         std::variant<std::string, LoaderFunction> src;
         std::variant<texture*, model*, vk::Image, vk::Buffer> dst;
         std::promise<void> promise;
+        std::chrono::steady_clock::time_point enqueued;
+        size_t bytes = 0; // estimated before loading, used for progress reporting
+    };
+
+    struct LoadMetrics
+    {
+        std::string name;
+        LoadType type;
+        int thread;
+
+        std::chrono::nanoseconds queueWait{};
+        std::chrono::nanoseconds read{};
+        std::chrono::nanoseconds decode{};
+        std::chrono::nanoseconds staging{};
+        std::chrono::nanoseconds transfer{}; // submit until the fence is signaled
+
+        size_t fileBytes = 0;
+        size_t uploadBytes = 0;
+        bool failed = false; // the times and sizes are only partial then
+
+        std::chrono::nanoseconds latency() const { return queueWait + read + decode + staging + transfer; }
+    };
+
+    struct LoaderProgress
+    {
+        size_t tasksQueued = 0;
+        size_t tasksCompleted = 0; // including the failed ones
+        size_t tasksFailed = 0;
+        size_t bytesQueued = 0;
+        size_t bytesCompleted = 0;
+    };
+
+    struct LoaderStatistics
+    {
+        size_t tasksQueued = 0;
+        size_t tasksCompleted = 0; // including the failed ones
+        size_t tasksFailed = 0;
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+
+        size_t fileBytes = 0;
+        size_t uploadBytes = 0;
+
+        std::chrono::nanoseconds queueWait{};
+        std::chrono::nanoseconds read{};
+        std::chrono::nanoseconds decode{};
+        std::chrono::nanoseconds staging{};
+        std::chrono::nanoseconds transfer{};
+
+        std::chrono::nanoseconds p50Latency{};
+        std::chrono::nanoseconds p99Latency{};
+        std::chrono::nanoseconds maxLatency{};
+
+        // first enqueue until last completion
+        std::chrono::nanoseconds wallTime{};
+        double throughput = 0.0; // uploaded MiB per second of wall time
     };
 
     class resource_loader
@@ -42,7 +100,7 @@ namespace render
         public:
             resource_loader(vk::Device device, vma::Allocator allocator,
                 uint32_t transferFamily, uint32_t graphicsFamily,
-                std::vector<vk::Queue> queues);
+                std::vector<vk::Queue> queues, std::mutex* sharedQueueMutex = nullptr);
             ~resource_loader();
 
             std::future<void> loadTexture(texture* texture, std::string filename);
@@ -51,12 +109,18 @@ namespace render
             std::future<void> loadModel(model* model, std::string filename);
 
             static vk::Extent2D getImageSize(std::string filename);
+
+            LoaderProgress progress();
+            LoaderStatistics statistics();
+            std::vector<LoadMetrics> metrics();
+            void writeStatistics(std::ostream& out);
         private:
             vk::Device device;
             vma::Allocator allocator;
 
             uint32_t transferFamily;
             uint32_t graphicsFamily;
+            std::mutex* sharedQueueMutex; // held while submitting if the queues are also used by the renderer
 
             std::mutex lock;
             std::vector<std::thread> threads;
@@ -64,6 +128,17 @@ namespace render
             std::condition_variable cv;
             bool quit = false;
 
+            std::mutex statsLock;
+            std::vector<LoadMetrics> completed;
+            size_t tasksQueued = 0;
+            size_t tasksFailed = 0;
+            size_t maxQueueDepth = 0;
+            size_t bytesQueued = 0;
+            size_t bytesCompleted = 0;
+            std::chrono::steady_clock::time_point firstEnqueue;
+            std::chrono::steady_clock::time_point lastCompletion;
+
+            std::future<void> enqueue(LoadTask task);
             void loadThread(int index, vk::Queue queue);
 
             constexpr static vk::DeviceSize stagingSize = 16*1024*1024;
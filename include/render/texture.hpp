@@ -8,11 +8,13 @@ namespace render
 {
     struct texture
     {
+        // more than one layer makes it a 2D array image with an array view
         texture(vk::Device device, vma::Allocator allocator, int width, int height,
             vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled,
             vk::Format format = vk::Format::eR8G8B8A8Srgb,
             vk::SampleCountFlagBits sampleCount = vk::SampleCountFlagBits::e1,
-            bool transfer = true, vk::ImageAspectFlags aspects = vk::ImageAspectFlagBits::eColor);
+            bool transfer = true, vk::ImageAspectFlags aspects = vk::ImageAspectFlagBits::eColor,
+            uint32_t layers = 1);
         texture(vk::Device device, vma::Allocator allocator, vk::Extent2D extent,
             vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled,
             vk::Format format = vk::Format::eR8G8B8A8Srgb,
@@ -37,6 +39,7 @@ namespace render
 
         int width;
         int height;
+        uint32_t layers = 1;
 
         vk::UniqueImageView imageView;
 
@@ -3,7 +3,16 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
 
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace render
 {
+    using shader_map = std::map<std::string, vk::UniqueShaderModule>;
+
     vk::UniqueShaderModule createShader(vk::Device device, std::string file);
+    // reads and creates all shaders concurrently, the modules are keyed by file name
+    std::future<shader_map> createShaders(vk::Device device, std::vector<std::string> files);
 }
@@ -9,9 +9,14 @@
 
 #include <optional>
 #include <memory>
+#include <mutex>
 #include <chrono>
+#include <deque>
+#include <set>
+#include <string>
 
 #include "phase.hpp"
+#include "phases/loading_screen.hpp"
 #include "resource_loader.hpp"
 #include "entity/ticker.hpp"
 
@@ -43,10 +48,13 @@ namespace render
             void init();
             void loop();
 
+            void set_loading_screen(phases::loading_screen* screen);
             void set_phase(phase* renderer, entity::ticker* ticker);
 
             std::unique_ptr<resource_loader> loader;
 
+            std::unique_ptr<phases::loading_screen> loadingScreen;
+
             std::unique_ptr<phase> current_renderer;
             std::unique_ptr<entity::ticker> current_ticker;
 
@@ -72,15 +80,21 @@ namespace render
             vk::PhysicalDevice physicalDevice;
 
             vk::PhysicalDeviceProperties deviceProperties;
+            vk::PhysicalDeviceFeatures deviceFeatures; // enabled on the device
+            vk::PhysicalDeviceVulkan12Features deviceFeatures12;
+            std::set<std::string> enabledDeviceExtensions;
             QueueFamilyIndices queueFamilyIndices;
             SwapChainSupportDetails swapchainSupport;
 
             vk::UniqueDevice device;
             vma::Allocator allocator;
+            vk::UniquePipelineCache pipelineCache; // shared by all phases, persisted in CONFIG.pipelineCacheFile
 
             vk::Queue graphicsQueue;
             vk::Queue presentQueue;
             std::vector<vk::Queue> transferQueues;
+            // Vulkan needs submits to one queue synchronized, the loader may share the graphics queue
+            std::mutex queueMutex;
 
             vk::SurfaceFormatKHR swapchainFormat;
             vk::PresentModeKHR swapchainPresentMode;
@@ -92,21 +106,32 @@ namespace render
             std::vector<vk::UniqueImageView> swapchainImageViews;
             std::vector<vk::ImageView> swapchainImageViewsRaw;
 
-            const int MAX_FRAMES_IN_FLIGHT = 2;
+            int framesInFlight = 2; // CONFIG.framesInFlight, limited by the number of swapchain images
             std::vector<vk::UniqueSemaphore> imageAvailableSemaphores;
             std::vector<vk::UniqueSemaphore> renderFinishedSemaphores;
             std::vector<vk::UniqueFence> fences;
 
             std::vector<vk::Fence> imagesInFlight;
             std::vector<vk::Fence> inFlightFences;
+            int currentFrame = 0;
 
             decltype(std::chrono::high_resolution_clock::now()) lastFrame;
+            decltype(std::chrono::high_resolution_clock::now()) nextFrame; // earliest start of the next frame with CONFIG.frameRateLimit
+            static constexpr std::chrono::microseconds limiterSpin{1500}; // before the next frame, shorter waits are spun instead of slept
+
+            // VK_KHR_present_wait lets the time from sampling the input until the frame was presented be measured
+            bool presentWait = false;
+            uint64_t presentCount = 0; // the id of the last present
+            std::deque<std::pair<uint64_t, std::chrono::high_resolution_clock::time_point>> pendingPresents; // with the time of their input
+            static constexpr size_t maxPendingPresents = 16; // older ones are dropped without being measured
+            static constexpr uint64_t presentPollInterval = 250000; // in nanoseconds, how often the fence is checked while presents are waited for
+            double presentLatency = 0.0; // in milliseconds, smoothed, 0 if not measured
 
             static constexpr int fpsSampleRate = 10;
-            uint64_t framesInSecond;
+            uint64_t framesInSecond = 0;
             decltype(std::chrono::high_resolution_clock::now()) lastFPS;
-            int fpsCount;
-            double currentFPS;
+            int fpsCount = 0;
+            double currentFPS = 0.0;
 
 #ifndef NDEBUG
             vk::UniqueDebugUtilsMessengerEXT debugMessenger;
@@ -115,6 +140,17 @@ namespace render
             void initWindow();
             void initVulkan();
 
+            // waits for the frame to be free and for the frame rate limit, then acquires its image
+            uint32_t acquireFrame();
+            void submitFrame(phase* renderer, uint32_t imageIndex, std::chrono::high_resolution_clock::time_point inputTime);
+            void renderFrame(phase* renderer); // only polls the input, used while loading
+            void limitFrameRate();
+            // waits up to timeout nanoseconds for the oldest pending present, the later ones are only checked
+            void pollPresents(uint64_t timeout = 0);
+
+            void loadPipelineCache();
+            void savePipelineCache();
+
             int rateDeviceSuitability(vk::PhysicalDevice phyDev);
             QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice phyDev);
             SwapChainSupportDetails querySwapChainSupport(vk::PhysicalDevice phyDev);
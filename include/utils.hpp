@@ -16,6 +16,23 @@ namespace utils
     bool is_ready(std::shared_future<R> const& f)
     { return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
 
+    // ready and finished without an exception
+    template<typename R>
+    bool has_succeeded(std::shared_future<R> const& f)
+    {
+        if(!is_ready(f))
+            return false;
+        try
+        {
+            f.get();
+            return true;
+        }
+        catch(...)
+        {
+            return false;
+        }
+    }
+
     std::string to_fixed_string(double d, int n);
 
     template<int n, typename T>
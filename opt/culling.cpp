@@ -0,0 +1,98 @@
+#include "render/culling.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+namespace render::culling
+{
+    frustum frustum::from_matrix(const glm::mat4& m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        // the near plane assumes a depth range of [-w, w], which is a conservative bound for [0, w] as well
+        frustum f{{row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2}};
+        for(auto& p : f.planes)
+            p /= glm::length(glm::vec3(p));
+        return f;
+    }
+
+    void aabb_list::clear()
+    {
+        minX.clear(); minY.clear(); minZ.clear();
+        maxX.clear(); maxY.clear(); maxZ.clear();
+    }
+
+    void aabb_list::push_back(const glm::mat4& transform, glm::vec3 min, glm::vec3 max)
+    {
+        glm::vec3 center = transform * glm::vec4((min + max) * 0.5f, 1.0f);
+        glm::vec3 extent = (max - min) * 0.5f;
+        glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x
+            + glm::abs(glm::vec3(transform[1])) * extent.y
+            + glm::abs(glm::vec3(transform[2])) * extent.z;
+
+        minX.push_back(center.x - worldExtent.x);
+        minY.push_back(center.y - worldExtent.y);
+        minZ.push_back(center.z - worldExtent.z);
+        maxX.push_back(center.x + worldExtent.x);
+        maxY.push_back(center.y + worldExtent.y);
+        maxZ.push_back(center.z + worldExtent.z);
+    }
+
+    static bool inside(const frustum& f, const aabb_list& b, size_t i)
+    {
+        for(const auto& p : f.planes)
+        {
+            // corner furthest along the plane normal
+            float x = p.x >= 0.0f ? b.maxX[i] : b.minX[i];
+            float y = p.y >= 0.0f ? b.maxY[i] : b.minY[i];
+            float z = p.z >= 0.0f ? b.maxZ[i] : b.minZ[i];
+            if(p.x*x + p.y*y + p.z*z + p.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    size_t cull(const frustum& f, const aabb_list& b, std::vector<uint8_t>& visible)
+    {
+        size_t count = b.size();
+        visible.resize(count);
+
+        size_t visibleCount = 0;
+        size_t i = 0;
+#ifdef CULLING_SSE
+        for(; i+4 <= count; i+=4)
+        {
+            __m128 outside = _mm_setzero_ps();
+            for(const auto& p : f.planes)
+            {
+                __m128 x = _mm_loadu_ps((p.x >= 0.0f ? b.maxX : b.minX).data()+i);
+                __m128 y = _mm_loadu_ps((p.y >= 0.0f ? b.maxY : b.minY).data()+i);
+                __m128 z = _mm_loadu_ps((p.z >= 0.0f ? b.maxZ : b.minZ).data()+i);
+
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for(int j=0; j<4; j++)
+            {
+                visible[i+j] = !(mask & (1 << j));
+                visibleCount += visible[i+j];
+            }
+        }
+#endif
+        for(; i<count; i++)
+        {
+            visible[i] = inside(f, b, i);
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+}
@@ -1,8 +1,27 @@
 #version 450
 
+layout(location = 0) in vec2 inTexCoord;
+
 layout(location = 0) out vec4 outColor;
 
+layout(set = 0, binding = 0) uniform sampler2D background;
+
+layout(push_constant) uniform PushConstants
+{
+    float progress;
+} pc;
+
+const vec2 barMin = vec2(0.1, 0.90);
+const vec2 barMax = vec2(0.9, 0.92);
+
 void main()
 {
-    outColor = vec4(0.0, 0.0, 0.0, 1.0);
+    outColor = texture(background, inTexCoord);
+
+    if(all(greaterThanEqual(inTexCoord, barMin)) && all(lessThanEqual(inTexCoord, barMax)))
+    {
+        float x = (inTexCoord.x - barMin.x) / (barMax.x - barMin.x);
+        vec3 bar = x <= pc.progress ? vec3(1.0) : vec3(0.15);
+        outColor = vec4(mix(outColor.rgb, bar, 0.8), 1.0);
+    }
 }
@@ -0,0 +1,17 @@
+#version 450
+
+// the depth test against the far plane already skipped all pixels without geometry
+layout(early_fragment_tests) in;
+
+layout(location = 0) in vec2 inPosition;
+
+layout(location = 0) out vec4 outColor;
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput inputColor;
+
+// drawn once before the lights are added on top, matches the ambient term of light.comp
+void main()
+{
+    vec3 color = subpassLoad(inputColor).rgb;
+    outColor = vec4(0.05 * color * color, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+
+layout(location = 0) out vec4 outColor;
+
+// lit by light.comp
+layout(set = 0, binding = 3, rgba16f) uniform readonly image2D litImage;
+
+void main()
+{
+    outColor = imageLoad(litImage, ivec2(gl_FragCoord.xy));
+}
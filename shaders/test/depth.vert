@@ -0,0 +1,32 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in uint inInstance;
+
+// the main pass only draws where its depth is equal to this one, so both have to compute it the same way
+invariant gl_Position;
+
+layout(set = 0, binding = 0, std140) uniform UBO
+{
+    mat4 projection;
+    mat4 view;
+} global;
+struct ModelInfo
+{
+    mat4 transformation;
+    vec4 min;
+    vec4 max;
+    uvec4 material;
+};
+layout(set = 0, binding = 1, std430) readonly buffer Models
+{
+    ModelInfo models[];
+};
+
+// depth pre-pass, there is no fragment shader
+void main()
+{
+    ModelInfo model = models[inInstance];
+
+    gl_Position = global.projection * global.view * model.transformation * vec4(inPosition, 1.0);
+}
@@ -7,12 +7,17 @@ layout(set = 0, binding = 0, std140) uniform UBO
     mat4 projection;
     mat4 view;
 } global;
-layout(set = 0, binding = 1, std140) uniform UBO2
+struct ModelInfo
 {
     mat4 transformation;
     vec4 min;
     vec4 max;
-} model;
+    uvec4 material; // x: index into the texture array
+};
+layout(set = 0, binding = 1, std430) readonly buffer Models
+{
+    ModelInfo models[];
+};
 
 vec3 positions[24] = vec3[](
     vec3(0.0, 0.0, 0.0),
@@ -56,6 +61,7 @@ vec3 positions[24] = vec3[](
 
 void main()
 {
+    ModelInfo model = models[gl_InstanceIndex];
     vec3 inPosition = mix(model.min.xyz, model.max.xyz, positions[gl_VertexIndex]);
 
     vec4 pos = global.projection * global.view * vec4(inPosition, 1.0);
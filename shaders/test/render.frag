@@ -1,20 +1,34 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) flat in uint inTexture;
 
 layout(location = 0) out vec4 outColor;
-layout(location = 1) out vec4 outShade;
+layout(location = 1) out ivec2 outShade; // octahedral normal as snorm16, integer so that it is not averaged by the resolve
 
 const vec3 color = vec3(0.7, 0.7, 0.7);
 
-layout(set = 1, binding = 0) uniform sampler2D albedoTexture;
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// octahedral encoding, the same as octDecode in shade.frag
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v, vec2(0.0)));
+}
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return n.xy;
+}
 
 void main()
 {
     vec3 normal = normalize(inNormal);
 
-    outColor = texture(albedoTexture, inTexCoord);
-    outShade = vec4(normal, inPosition.z/inPosition.w);
+    outColor = texture(textures[nonuniformEXT(inTexture)], inTexCoord);
+    outShade = ivec2(round(octEncode(normal) * 32767.0)); // depth is read from the depth buffer
 }
@@ -3,23 +3,37 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in uint inInstance;
 
 layout(location = 0) out vec4 outPosition;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 outTexCoord;
+layout(location = 3) flat out uint outTexture;
+
+// has to match depth.vert exactly for the depth pre-pass
+invariant gl_Position;
 
 layout(set = 0, binding = 0, std140) uniform UBO
 {
     mat4 projection;
     mat4 view;
 } global;
-layout(set = 0, binding = 1, std140) uniform UBO2
+struct ModelInfo
 {
     mat4 transformation;
-} model;
+    vec4 min;
+    vec4 max;
+    uvec4 material; // x: index into the texture array
+};
+layout(set = 0, binding = 1, std430) readonly buffer Models
+{
+    ModelInfo models[];
+};
 
 void main()
 {
+    ModelInfo model = models[inInstance];
+
     vec4 pos = global.projection * global.view * model.transformation * vec4(inPosition, 1.0);
     outPosition = pos;
     gl_Position = pos;
@@ -37,4 +51,5 @@ void main()
     outNormal = ((normalModelMatrix * inNormal.xyz).xyz).xyz;
 
     outTexCoord = inTexCoord;
+    outTexture = model.material.x;
 }
@@ -1,66 +1,109 @@
 #version 450
 
+// the depth test against the far plane already skipped all pixels without geometry
+layout(early_fragment_tests) in;
+
 layout(location = 0) in vec2 inPosition;
 
 layout(location = 0) out vec4 outColor;
 
 layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput inputColor;
-layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput inputShading;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform isubpassInput inputShading; // octahedral normal as snorm16
+layout(input_attachment_index = 2, set = 0, binding = 3) uniform subpassInput inputDepth;
 
 layout(set = 0, binding = 2, std140) uniform UBO
 {
-    vec4 position;
+    vec4 position; // w = 0 for directional lights
     vec4 direction;
-    vec4 color;
+    vec4 color; // w: radius, 0 if it reaches everywhere
 
-    mat4 lightMatrix;
     mat4 globalInverse;
+    vec4 cascadeSplits; // depth at which each cascade ends
+    ivec4 shadow; // x: first layer, y: number of layers
 } light;
 
-layout(set = 1, binding = 0) uniform sampler2D shadowMap;
-const int pcfCount = 2;
+layout(set = 1, binding = 0) uniform sampler2DArray shadowMaps;
+struct GlobalInfo
+{
+    mat4 projection;
+    mat4 view;
+};
+layout(set = 1, binding = 1, std140) uniform ShadowViews
+{
+    GlobalInfo views[8]; // one per shadow map layer, render_test::maxShadowLayers
+};
+
+// chosen per light by the renderer, see render_test::ShadeVariant
+layout(constant_id = 0) const int pcfRadius = 2;
+layout(constant_id = 1) const bool shadows = true;
+
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v, vec2(0.0)));
+}
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = octWrap(n.xy);
+    return normalize(n);
+}
+
+float falloff(float distance, float radius)
+{
+    if(radius <= 0.0)
+        return 1.0;
+    float x = distance / radius;
+    x = clamp(1.0 - x*x*x*x, 0.0, 1.0);
+    return x*x;
+}
 
 void main()
 {
     vec3 color = subpassLoad(inputColor).rgb;
-    vec4 shading = subpassLoad(inputShading);
+    float depth = subpassLoad(inputDepth).r;
 
-    vec4 position = vec4(inPosition, shading.w, 1.0);
+    vec4 position = vec4(inPosition, depth, 1.0);
 
     vec4 originalPosition = light.globalInverse * position;
     originalPosition = originalPosition / originalPosition.w;
 
-    vec4 lightPosition = light.lightMatrix * originalPosition;
-    vec3 lightCoords = lightPosition.xyz / lightPosition.w;
-    lightCoords.xy = lightCoords.xy * 0.5 + vec2(0.5);
-    float currentDepth = min(lightCoords.z, 1.0);
-
-    vec3 normal = normalize(shading.xyz);
-    vec3 lightDir = normalize(light.position.xyz - originalPosition.xyz);
-
-    //vec3 ambient = 0.15 * color;
-    vec3 ambient = 0.05 * color;
+    vec3 normal = octDecode(vec2(subpassLoad(inputShading).xy) / 32767.0);
+    vec3 lightDir = normalize(light.position.w == 0.0 ? light.position.xyz : light.position.xyz - originalPosition.xyz);
 
     float diff = max(dot(normal, lightDir), 0);
+    if(light.position.w != 0.0)
+        diff *= falloff(distance(light.position.xyz, originalPosition.xyz), light.color.w);
     vec3 diffuse = diff * light.color.rgb;
 
     //float bias = max(0.05 * (1.0 - dot(normal, light.position.xyz - originalPosition.xyz)), 0.005);
     float bias = 0.0005;
     float shadow = 0.0;
-    vec2 texelSize = vec2(1.0) / textureSize(shadowMap, 0);
-    for(int x = -pcfCount; x <= pcfCount; ++x)
+    // the first cascade that reaches far enough, there are none left beyond the shadow distance
+    int cascade = 0;
+    while(cascade < light.shadow.y && depth > light.cascadeSplits[cascade])
+        cascade++;
+    if(shadows && cascade < light.shadow.y)
     {
-        for(int y = -pcfCount; y <= pcfCount; ++y)
+        int layer = light.shadow.x + cascade;
+        vec4 lightPosition = views[layer].projection * views[layer].view * originalPosition;
+        vec3 lightCoords = lightPosition.xyz / lightPosition.w;
+        lightCoords.xy = lightCoords.xy * 0.5 + vec2(0.5);
+        float currentDepth = min(lightCoords.z, 1.0);
+
+        vec2 texelSize = vec2(1.0) / textureSize(shadowMaps, 0).xy;
+        for(int x = -pcfRadius; x <= pcfRadius; ++x)
         {
-            float pcfDepth = texture(shadowMap, lightCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            for(int y = -pcfRadius; y <= pcfRadius; ++y)
+            {
+                float pcfDepth = texture(shadowMaps, vec3(lightCoords.xy + vec2(x, y) * texelSize, layer)).r;
+                shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            }
         }
+        shadow /= float((2*pcfRadius+1)*(2*pcfRadius+1));
     }
-    shadow /= float((2*pcfCount+1)*(2*pcfCount+1));
 
-    vec3 lighting = (ambient + (1.0 - shadow) * (diffuse)) * color;
+    // the ambient term is added once by ambient.frag, not once per light
+    vec3 lighting = (1.0 - shadow) * diffuse * color;
     outColor = vec4(lighting, 1.0);
-
-    if(shading == vec4(0.0))
-        outColor = vec4(color, 1.0);
 }
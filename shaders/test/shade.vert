@@ -15,5 +15,5 @@ layout(location = 0) out vec2 outPosition;
 void main()
 {
     outPosition = positions[gl_VertexIndex];
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = vec4(positions[gl_VertexIndex], 1.0, 1.0); // on the far plane, see shadeDepthStencil
 }
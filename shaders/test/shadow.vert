@@ -0,0 +1,37 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in uint inInstance; // model slot, shadow map layer in the upper 8 bits
+
+layout(location = 0) flat out uint outLayer;
+
+struct GlobalInfo
+{
+    mat4 projection;
+    mat4 view;
+};
+layout(set = 0, binding = 0, std140) uniform UBO
+{
+    GlobalInfo views[8]; // one per shadow map layer, render_test::maxShadowLayers
+};
+struct ModelInfo
+{
+    mat4 transformation;
+    vec4 min;
+    vec4 max;
+    uvec4 material;
+};
+layout(set = 0, binding = 1, std430) readonly buffer Models
+{
+    ModelInfo models[];
+};
+
+// without VK_EXT_shader_viewport_index_layer, shadow.geom picks the layer
+void main()
+{
+    uint layer = inInstance >> 24;
+    ModelInfo model = models[inInstance & 0xffffffu];
+
+    gl_Position = views[layer].projection * views[layer].view * model.transformation * vec4(inPosition, 1.0);
+    outLayer = layer;
+}
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 3) in uint inInstance; // model slot, shadow map layer in the upper 8 bits
+
+struct GlobalInfo
+{
+    mat4 projection;
+    mat4 view;
+};
+layout(set = 0, binding = 0, std140) uniform UBO
+{
+    GlobalInfo views[8]; // one per shadow map layer, render_test::maxShadowLayers
+};
+struct ModelInfo
+{
+    mat4 transformation;
+    vec4 min;
+    vec4 max;
+    uvec4 material;
+};
+layout(set = 0, binding = 1, std430) readonly buffer Models
+{
+    ModelInfo models[];
+};
+
+void main()
+{
+    uint layer = inInstance >> 24;
+    ModelInfo model = models[inInstance & 0xffffffu];
+
+    gl_Position = views[layer].projection * views[layer].view * model.transformation * vec4(inPosition, 1.0);
+    gl_Layer = int(layer);
+}
@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+
+layout(location = 0) out vec4 outColor;
+
+// shaded at the resolution of this frame, in the top left part of the image
+layout(set = 0, binding = 0) uniform sampler2D scene;
+
+layout(push_constant) uniform Push
+{
+    vec2 scale; // of the rendered part in texture coordinates
+    vec2 limit; // half a texel inside of it, so that bilinear filtering does not reach outside
+} push;
+
+void main()
+{
+    vec2 uv = (inPosition * 0.5 + vec2(0.5)) * push.scale;
+    outColor = texture(scene, min(uv, push.limit));
+}
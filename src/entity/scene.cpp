@@ -0,0 +1,157 @@
+#include "entity/scene.hpp"
+
+#include "entity/components/camera.hpp"
+#include "entity/components/collision.hpp"
+#include "entity/components/light.hpp"
+#include "entity/components/model.hpp"
+#include "entity/components/player.hpp"
+#include "entity/components/position.hpp"
+#include "entity/components/renderable.hpp"
+#include "entity/components/rotation.hpp"
+#include "entity/components/velocity.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+namespace entity
+{
+    entt::hashed_string::hash_type asset_names::add(const std::string& name)
+    {
+        auto hash = entt::hashed_string::value(name.c_str(), name.size());
+        names.try_emplace(hash, name);
+        return hash;
+    }
+
+    const std::string* asset_names::find(entt::hashed_string::hash_type hash) const
+    {
+        auto it = names.find(hash);
+        return it == names.end() ? nullptr : &it->second;
+    }
+
+    std::map<std::string, entity_id> load_scene(entt::registry& registry, const std::string& filename)
+    {
+        std::ifstream in(filename);
+        if(!in)
+            throw std::runtime_error("failed to open scene "+filename);
+
+        auto& assets = registry.ctx().emplace<asset_names>();
+        std::map<std::string, entity_id> named;
+        entity_id current = entt::null;
+
+        std::string line;
+        for(int number = 1; std::getline(in, line); number++)
+        {
+            auto error = [&](std::string what){
+                return std::runtime_error(filename+":"+std::to_string(number)+": "+what);
+            };
+
+            std::istringstream s(line);
+            std::string type;
+            if(!(s >> type) || type.starts_with('#'))
+                continue;
+
+            if(type == "entity")
+            {
+                std::string name;
+                if(!(s >> name))
+                    throw error("entity without a name");
+                if(named.contains(name))
+                    throw error("duplicate entity "+name);
+                current = named[name] = registry.create();
+                continue;
+            }
+            if(current == entt::null)
+                throw error("component "+type+" outside of an entity");
+
+            if(type == "position")
+            {
+                components::position p{};
+                s >> p.x >> p.y >> p.z;
+                registry.emplace_or_replace<components::position>(current, p);
+            }
+            else if(type == "rotation")
+            {
+                components::rotation r{};
+                if(s >> r.yaw >> r.pitch)
+                {
+                    r.yaw = glm::radians(r.yaw);
+                    r.pitch = glm::radians(r.pitch);
+                }
+                registry.emplace_or_replace<components::rotation>(current, r);
+            }
+            else if(type == "velocity")
+            {
+                registry.emplace_or_replace<components::velocity>(current);
+            }
+            else if(type == "player")
+            {
+                registry.emplace_or_replace<components::player>(current);
+            }
+            else if(type == "collision")
+            {
+                registry.emplace_or_replace<components::collision>(current);
+            }
+            else if(type == "light" || type == "sun")
+            {
+                components::light l{};
+                l.directional = type == "sun";
+                if(!(s >> l.direction.x >> l.direction.y >> l.direction.z >> l.color.r >> l.color.g >> l.color.b))
+                    throw error("light needs a direction and a color");
+                if(float zNear, zFar; s >> zNear >> zFar)
+                {
+                    l.zNear = zNear;
+                    l.zFar = zFar;
+                }
+                registry.emplace_or_replace<components::light>(current, l);
+            }
+            else if(type == "lamp")
+            {
+                components::light l{};
+                l.castShadow = false;
+                l.direction = glm::vec3(0.0, 1.0, 0.0); // unused, but normalized like every other
+                if(!(s >> l.color.r >> l.color.g >> l.color.b >> l.radius))
+                    throw error("lamp needs a color and a radius");
+                registry.emplace_or_replace<components::light>(current, l);
+            }
+            else if(type == "model")
+            {
+                std::string model, texture;
+                if(!(s >> model >> texture))
+                    throw error("model needs a model and a texture file");
+                registry.emplace_or_replace<components::model>(current, assets.add(model), assets.add(texture));
+            }
+            else if(type == "renderable")
+            {
+                components::renderable r{};
+                s >> r.shadowCaster >> r.shadowCatcher;
+                registry.emplace_or_replace<components::renderable>(current, r);
+            }
+            else if(type == "target_camera")
+            {
+                std::string target;
+                if(!(s >> target) || !named.contains(target))
+                    throw error("camera target must be an entity defined before");
+
+                components::target_camera cam{.target = named[target]};
+                if(glm::vec3 offset; s >> offset.x >> offset.y >> offset.z)
+                    cam.offset = offset;
+                if(s >> cam.yaw >> cam.pitch)
+                {
+                    cam.yaw = glm::radians(cam.yaw);
+                    cam.pitch = glm::radians(cam.pitch);
+                }
+                registry.emplace_or_replace<components::target_camera>(current, cam);
+            }
+            else
+            {
+                throw error("unknown component "+type);
+            }
+        }
+        spdlog::info("Loaded scene {} with {} entities and {} assets", filename, named.size(), assets.names.size());
+
+        return named;
+    }
+}
@@ -17,15 +17,18 @@ namespace entity
         glfwSetWindowUserPointer(win->win.get(), this);
         glfwSetScrollCallback(win->win.get(), [](GLFWwindow* w, double x, double y){
             ticker* t = (ticker*)glfwGetWindowUserPointer(w);
-            t->on_scroll(x, y);
+            if(t)
+                t->on_scroll(x, y);
         });
         glfwSetCursorPosCallback(win->win.get(), [](GLFWwindow* w, double x, double y){
             ticker* t = (ticker*)glfwGetWindowUserPointer(w);
-            t->on_cursor_pos(x, y);
+            if(t)
+                t->on_cursor_pos(x, y);
         });
         glfwSetKeyCallback(win->win.get(), [](GLFWwindow* w, int key, int scancode, int action, int mods){
             ticker* t = (ticker*)glfwGetWindowUserPointer(w);
-            t->on_key(key, scancode, action, mods);
+            if(t)
+                t->on_key(key, scancode, action, mods);
         });
     }
 
@@ -9,6 +9,8 @@
 #include "entity/components/rotation.hpp"
 #include "entity/components/collision.hpp"
 
+#include <cmath>
+
 namespace entity
 {
     void world_ticker::init(render::window* win)
@@ -82,24 +84,23 @@ namespace entity
 
     void world_ticker::tick(double dt)
     {
+        // position and rotation are patched, so that the renderer notices what moved
         {
-            auto view = registry.view<const components::player, components::rotation, components::velocity>();
+            auto view = registry.view<const components::player, const components::rotation, components::velocity>();
             for(auto [id, player, rotation, velocity] : view.each())
             {
-                if(player.motionForward > 0.0)
-                {
-                    rotation.yaw = glm::radians(180.0)-registry.get<components::target_camera>(camera).yaw;
-
-                    velocity.x = sin(rotation.yaw) * player.walkingSpeed;
-                    velocity.z = cos(rotation.yaw) * player.walkingSpeed;
-                }
-                else if(player.motionForward < 0.0)
-                {
-                    rotation.yaw = -registry.get<components::target_camera>(camera).yaw;
-
-                    velocity.x = sin(rotation.yaw) * player.walkingSpeed;
-                    velocity.z = cos(rotation.yaw) * player.walkingSpeed;
-                }
+                if(player.motionForward == 0.0)
+                    continue;
+
+                double yaw = player.motionForward > 0.0 ?
+                    glm::radians(180.0)-registry.get<components::target_camera>(camera).yaw :
+                    -registry.get<components::target_camera>(camera).yaw;
+                registry.patch<components::rotation>(id, [yaw](components::rotation& r){
+                    r.yaw = yaw;
+                });
+
+                velocity.x = sin(yaw) * player.walkingSpeed;
+                velocity.z = cos(yaw) * player.walkingSpeed;
             }
         }
 
@@ -116,16 +117,21 @@ namespace entity
                 {
 
                 }
-                else
+                else if(tx != position.x || ty != position.y || tz != position.z)
                 {
-                    position.x = tx;
-                    position.y = ty;
-                    position.z = tz;
+                    registry.patch<components::position>(id, [tx, ty, tz](components::position& p){
+                        p.x = tx;
+                        p.y = ty;
+                        p.z = tz;
+                    });
                 }
 
+                // comes to a full stop instead of creeping on forever
                 velocity.x *= 0.9;
                 velocity.y *= 0.9;
                 velocity.z *= 0.9;
+                if(std::abs(velocity.x) + std::abs(velocity.y) + std::abs(velocity.z) < 1e-4)
+                    velocity.x = velocity.y = velocity.z = 0.0;
             }
         }
     }
@@ -6,18 +6,15 @@
 #include "render/gui_render_context.hpp"
 #include "render/window.hpp"
 #include "render/phases/render_test.hpp"
+#include "render/phases/loading_screen.hpp"
 
-#include "entity/components/light.hpp"
-#include "entity/components/position.hpp"
-#include "entity/components/rotation.hpp"
-#include "entity/components/velocity.hpp"
-#include "entity/components/player.hpp"
 #include "entity/components/renderable.hpp"
 #include "entity/components/model.hpp"
-#include "entity/components/camera.hpp"
 
+#include "entity/scene.hpp"
 #include "entity/word_ticker.hpp"
 
+#include "config.hpp"
 #include "utils.hpp"
 
 int main(int argc, char *argv[])
@@ -31,39 +28,13 @@ int main(int argc, char *argv[])
     entt::registry registry;
     registry.on_construct<entity::components::model>().connect<&entt::registry::emplace_or_replace<entity::components::renderable>>();
 
-    const auto light = registry.create();
-    registry.emplace<entity::components::light>(light, glm::vec3(1.0, 1.0, 1.0), glm::vec3(1.0, 0.5, 0.75), 1e-9f, 50.0f);
-    registry.emplace<entity::components::position>(light, 20.0, 35.0, 20.0);
-    registry.emplace<entity::components::model>(light, "monkey.obj"_hs, "soraka.png"_hs);
-    registry.emplace_or_replace<entity::components::renderable>(light, false, false);
-
-    const auto soraka = registry.create();
-    registry.emplace<entity::components::position>(soraka, 0.0, 0.0, 0.0);
-    registry.emplace<entity::components::rotation>(soraka);
-    registry.emplace<entity::components::velocity>(soraka);
-    //registry.emplace<entity::components::collision>(soraka);
-    registry.emplace<entity::components::player>(soraka);
-    registry.emplace<entity::components::model>(soraka, "soraka.obj"_hs, "soraka.png"_hs);
-
-    const auto ground = registry.create();
-    registry.emplace<entity::components::position>(ground, 0.0, 0.0, 0.0);
-    registry.emplace<entity::components::collision>(ground);
-    registry.emplace<entity::components::model>(ground, "plane.obj"_hs, "ground.png"_hs);
-
-    const auto cube = registry.create();
-    registry.emplace<entity::components::position>(cube, -1.0, 0.25, -0.5);
-    registry.emplace<entity::components::collision>(cube);
-    registry.emplace<entity::components::model>(cube, "cube.obj"_hs, "gray.png"_hs);
-
-    const auto camera = registry.create();
-    registry.emplace<entity::components::target_camera>(camera, soraka, glm::vec3(0.0, 2.0, 0.0));
-    registry.patch<entity::components::target_camera>(camera, [](entity::components::target_camera& cam){
-        cam.yaw = glm::radians(180.0f);
-        cam.pitch = glm::radians(30.0f);
-    });
+    auto scene = entity::load_scene(registry, argc > 1 ? argv[1] : "assets/scenes/test.scene");
+    const auto soraka = scene.at("soraka");
+    const auto camera = scene.at("camera");
 
     render::window window;
     window.init();
+    window.set_loading_screen(new render::phases::loading_screen(&window));
 
     render::phases::render_test* renderer;
     entity::world_ticker* ticker;
@@ -71,12 +42,39 @@ int main(int argc, char *argv[])
         ctx.draw_text("Hello world!", 0.0, 0.0, 0.05f, glm::vec4(1.0, 1.0, 1.0, 1.0));
         ctx.draw_text("Hello world!", 0.0, 2.0 - 0.05f, 0.05f, glm::vec4(1.0, 1.0, 1.0, 1.0));
 
-        ctx.draw_text("FPS: "+utils::to_fixed_string<1>(window.currentFPS), 0.05f, 0.05f + 0*0.05f, 0.05f);
+        ctx.draw_text("FPS: "+utils::to_fixed_string<1>(window.currentFPS)+(window.presentLatency > 0.0 ?
+            ", latency: "+utils::to_fixed_string<1>(window.presentLatency)+" ms" : ""), 0.05f, 0.05f + 0*0.05f, 0.05f);
         if(const auto& allocator = renderer->get_allocator()) {
             auto budget = allocator.getHeapBudgets().front();
             auto usage = ((double)budget.usage) / ((double)budget.budget);
             ctx.draw_text("VRAM: "+utils::to_fixed_string<1>(usage*100.0)+"%", 0.05f, 0.05f + 1*0.05f, 0.05f);
         }
+        const auto& culling = renderer->get_cull_statistics();
+        ctx.draw_text("Visible: "+std::to_string(culling.mainVisible)+"/"+std::to_string(culling.mainTotal)+
+            ", shadows: "+std::to_string(culling.shadowVisible)+"/"+std::to_string(culling.shadowTotal)+
+            " in "+std::to_string(culling.shadowLayersDrawn)+"/"+std::to_string(culling.shadowLayers)+" layers", 0.05f, 0.05f + 2*0.05f, 0.05f);
+        ctx.draw_text("Main pass: "+utils::to_fixed_string<2>(renderer->get_main_pass_time())+" ms"+
+            (config::CONFIG.depthPrepass ? " with depth pre-pass" : ""), 0.05f, 0.05f + 3*0.05f, 0.05f);
+        ctx.draw_text("GPU: "+utils::to_fixed_string<2>(renderer->get_frame_time())+" ms at "+
+            utils::to_fixed_string<0>(renderer->get_resolution_scale()*100.0)+"% resolution", 0.05f, 0.05f + 4*0.05f, 0.05f);
+
+        auto invocations = [](std::string_view stage, double count) -> std::string {
+            if(count < 0.5)
+                return "";
+            if(count >= 1.0e6)
+                return ", "+std::string(stage)+" "+utils::to_fixed_string<1>(count/1.0e6)+"M";
+            if(count >= 1.0e3)
+                return ", "+std::string(stage)+" "+utils::to_fixed_string<1>(count/1.0e3)+"k";
+            return ", "+std::string(stage)+" "+utils::to_fixed_string<0>(count);
+        };
+        int row = 5;
+        for(const auto& scope : renderer->get_profiler().results()) {
+            if(scope.depth == 0)
+                continue; // the whole frame is shown above
+            ctx.draw_text(std::string(2*scope.depth, ' ')+scope.name+": "+utils::to_fixed_string<2>(scope.time)+" ms"+
+                invocations("vert", scope.vertexInvocations)+invocations("frag", scope.fragmentInvocations)+invocations("comp", scope.computeInvocations),
+                0.05f, 0.05f + row++*0.05f, 0.04f);
+        }
     };
 
     window.set_phase(renderer = new render::phases::render_test(&window, registry, gui), ticker = new entity::world_ticker(registry, soraka, camera));
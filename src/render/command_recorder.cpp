@@ -0,0 +1,108 @@
+#include "render/command_recorder.hpp"
+#include "render/debug.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace render
+{
+    command_recorder::command_recorder(vk::Device device, uint32_t queueFamily, int frameCount, int threadCount) : device(device)
+    {
+        pools.resize(threadCount);
+        for(int t=0; t<threadCount; t++)
+        {
+            for(int f=0; f<frameCount; f++)
+            {
+                auto& p = pools[t].emplace_back();
+                p.pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, queueFamily));
+                debugName(device, p.pool.get(), "Command Recorder Pool #"+std::to_string(t)+":"+std::to_string(f));
+            }
+        }
+        for(int t=0; t<threadCount; t++)
+        {
+            threads.emplace_back(&command_recorder::recordThread, this, t);
+        }
+        spdlog::info("[Command Recorder] Started {} thread(s)", threadCount);
+    }
+
+    command_recorder::~command_recorder()
+    {
+        {
+            std::scoped_lock<std::mutex> l(lock);
+            quit = true;
+        }
+        cv.notify_all();
+        for(auto& t : threads)
+        {
+            if(t.joinable())
+                t.join();
+        }
+    }
+
+    void command_recorder::begin_frame(int frame)
+    {
+        // every job of the last frame has been waited for, so no thread touches these pools right now
+        for(auto& thread : pools)
+        {
+            frame_pool& p = thread[frame];
+            if(p.used == 0)
+                continue;
+            device.resetCommandPool(p.pool.get());
+            p.used = 0;
+        }
+    }
+
+    std::future<vk::CommandBuffer> command_recorder::record(int frame, vk::CommandBufferInheritanceInfo inheritance, job fn)
+    {
+        std::future<vk::CommandBuffer> f;
+        {
+            std::scoped_lock<std::mutex> l(lock);
+            task t{frame, inheritance, std::move(fn), std::promise<vk::CommandBuffer>()};
+            f = t.promise.get_future();
+            tasks.push(std::move(t));
+        }
+        cv.notify_one();
+        return f;
+    }
+
+    void command_recorder::recordThread(int index)
+    {
+        std::unique_lock<std::mutex> l(lock);
+        do
+        {
+            cv.wait(l, [this]{
+                return (tasks.size() || quit);
+            });
+
+            if(!quit && tasks.size())
+            {
+                auto t = std::move(tasks.front());
+                tasks.pop();
+                l.unlock();
+
+                try
+                {
+                    frame_pool& p = pools[index][t.frame];
+                    if(p.used == p.buffers.size())
+                    {
+                        p.buffers.push_back(device.allocateCommandBuffers(
+                            vk::CommandBufferAllocateInfo(p.pool.get(), vk::CommandBufferLevel::eSecondary, 1)).front());
+                    }
+                    vk::CommandBuffer commandBuffer = p.buffers[p.used++];
+
+                    commandBuffer.begin(vk::CommandBufferBeginInfo(
+                        vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &t.inheritance));
+                    t.fn(commandBuffer);
+                    commandBuffer.end();
+                    t.promise.set_value(commandBuffer);
+                }
+                catch(...)
+                {
+                    t.promise.set_exception(std::current_exception());
+                }
+
+                l.lock();
+            }
+        }
+        while(!quit);
+    }
+}
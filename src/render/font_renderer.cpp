@@ -39,7 +39,7 @@ namespace render
         }
     }
 
-    void font_renderer::preload(FT_Library ft, resource_loader* loader, vk::RenderPass renderPass)
+    void font_renderer::preload(FT_Library ft, resource_loader* loader, vk::RenderPass renderPass, vk::PipelineCache pipelineCache)
     {
         FT_Error err = FT_New_Face(ft, name.c_str(), 0, &face);
         if(err != 0) throw std::runtime_error("failed to load face");
@@ -191,30 +191,32 @@ namespace render
 
             vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
                 &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, pipelineLayout.get(), renderPass);
-            pipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
+            auto t0 = std::chrono::high_resolution_clock::now();
+            pipeline = device.createGraphicsPipelineUnique(pipelineCache, pipeline_info).value;
+            pipelineTime = std::chrono::high_resolution_clock::now() - t0;
             debugName(device, pipeline.get(), "Font Renderer Pipeline");
         }
     }
 
-    void font_renderer::prepare(int imageCount)
+    void font_renderer::prepare(int frameCount)
     {
         std::array<vk::DescriptorPoolSize, 2> sizes = {
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*imageCount)
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*frameCount)
         };
-        vk::DescriptorPoolCreateInfo pool_info({}, imageCount, sizes);
+        vk::DescriptorPoolCreateInfo pool_info({}, frameCount, sizes);
         descriptorPool = device.createDescriptorPoolUnique(pool_info);
 
-        std::vector<vk::DescriptorSetLayout> layouts(imageCount);
+        std::vector<vk::DescriptorSetLayout> layouts(frameCount);
         std::fill(layouts.begin(), layouts.end(), descriptorLayout.get());
         vk::DescriptorSetAllocateInfo set_info(descriptorPool.get(), layouts);
         descriptorSets = device.allocateDescriptorSets(set_info);
 
 
-        std::vector<vk::WriteDescriptorSet> writes(imageCount*2);
-        std::vector<vk::DescriptorBufferInfo> bufferInfos(imageCount);
+        std::vector<vk::WriteDescriptorSet> writes(frameCount*2);
+        std::vector<vk::DescriptorBufferInfo> bufferInfos(frameCount);
         vk::DescriptorImageInfo imageInfo(sampler.get(), fontTexture->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-        for(int i=0; i<imageCount; i++)
+        for(int i=0; i<frameCount; i++)
         {
             {
                 vk::BufferCreateInfo vertex_info({}, maxTexts*maxCharacters*sizeof(VertexCharacter), vk::BufferUsageFlagBits::eVertexBuffer);
@@ -242,8 +244,8 @@ namespace render
         }
         device.updateDescriptorSets(writes, {});
 
-        uniformOffsets.resize(imageCount);
-        vertexOffsets.resize(imageCount);
+        uniformOffsets.resize(frameCount);
+        vertexOffsets.resize(frameCount);
     }
 
     void font_renderer::renderText(vk::CommandBuffer cmd, int frame, std::string_view text, float x, float y, float scale, glm::vec4 color)
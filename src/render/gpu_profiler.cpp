@@ -0,0 +1,168 @@
+#include "render/gpu_profiler.hpp"
+#include "render/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+namespace render
+{
+    gpu_profiler::gpu_profiler(vk::PhysicalDevice physicalDevice, vk::Device device, const vk::PhysicalDeviceFeatures& enabledFeatures,
+        uint32_t queueFamily, int frameCount, bool statistics) : device(device)
+    {
+        uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+        if(validBits == 0)
+        {
+            spdlog::warn("[GPU Profiler] The queue has no timestamps, GPU times are not measured");
+            return;
+        }
+        timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+        timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits)-1;
+
+        timestampPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, 2*maxScopes*frameCount));
+        debugName(device, timestampPool.get(), "GPU Profiler Timestamp Query Pool");
+
+        // secondary command buffers inside a scope have to inherit the query, which needs inheritedQueries
+        if(statistics && !(enabledFeatures.pipelineStatisticsQuery && enabledFeatures.inheritedQueries))
+            spdlog::warn("[GPU Profiler] Pipeline statistics are not supported, only timing the GPU");
+        else if(statistics)
+        {
+            statisticsPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo({}, vk::QueryType::ePipelineStatistics, maxScopes*frameCount, statisticFlags));
+            debugName(device, statisticsPool.get(), "GPU Profiler Statistics Query Pool");
+        }
+        frames.resize(frameCount);
+        spdlog::debug("[GPU Profiler] Timing with {} ns per tick{}", timestampPeriod, has_statistics() ? " and counting shader invocations" : "");
+    }
+
+    bool gpu_profiler::begin_frame(vk::CommandBuffer commandBuffer, int frame)
+    {
+        if(!enabled())
+        {
+            begin_scope(commandBuffer, "Frame");
+            return false;
+        }
+
+        // the fence of this frame has been waited for, so its queries should be available, but they are never waited for
+        frame_queries& f = frames[frame];
+        bool read = f.written && read_results(frame);
+        commandBuffer.resetQueryPool(timestampPool.get(), 2*maxScopes*frame, 2*maxScopes);
+        if(statisticsPool)
+            commandBuffer.resetQueryPool(statisticsPool.get(), maxScopes*frame, maxScopes);
+        f.scopes.clear();
+        f.statisticsUsed = 0;
+        f.written = false;
+
+        currentFrame = frame;
+        openScopes.clear();
+        begin_scope(commandBuffer, "Frame");
+        return read;
+    }
+
+    void gpu_profiler::end_frame(vk::CommandBuffer commandBuffer)
+    {
+        // scopes left open would never get their end timestamp
+        while(openScopes.size() > 1)
+            end_scope(commandBuffer);
+        end_scope(commandBuffer);
+        if(enabled())
+            frames[currentFrame].written = true;
+    }
+
+    void gpu_profiler::begin_scope(vk::CommandBuffer commandBuffer, const char* name)
+    {
+        vk::DebugUtilsLabelEXT label{};
+        commandBuffer.beginDebugUtilsLabelEXT(label.setPLabelName(name));
+        if(!enabled())
+            return;
+
+        frame_queries& f = frames[currentFrame];
+        if(f.scopes.size() == maxScopes)
+        {
+            // still balanced with end_scope(), but not measured
+            openScopes.push_back(maxScopes);
+            return;
+        }
+        uint32_t index = f.scopes.size();
+        int depth = openScopes.size();
+
+        // queries of one type cannot be nested, so only the passes directly inside the frame are counted
+        int statistics = -1;
+        if(statisticsPool && depth == 1)
+        {
+            statistics = f.statisticsUsed++;
+            commandBuffer.beginQuery(statisticsPool.get(), maxScopes*currentFrame+statistics, {});
+        }
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestampPool.get(), 2*(maxScopes*currentFrame+index));
+
+        f.scopes.push_back({name, depth, statistics});
+        openScopes.push_back(index);
+    }
+
+    void gpu_profiler::end_scope(vk::CommandBuffer commandBuffer)
+    {
+        if(enabled() && !openScopes.empty())
+        {
+            uint32_t index = openScopes.back();
+            openScopes.pop_back();
+            if(index < maxScopes)
+            {
+                const recorded_scope& s = frames[currentFrame].scopes[index];
+                commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestampPool.get(), 2*(maxScopes*currentFrame+index)+1);
+                if(s.statistics >= 0)
+                    commandBuffer.endQuery(statisticsPool.get(), maxScopes*currentFrame+s.statistics);
+            }
+        }
+        commandBuffer.endDebugUtilsLabelEXT();
+    }
+
+    const gpu_profiler::scope_result* gpu_profiler::find(std::string_view name) const
+    {
+        auto it = std::find_if(scopeResults.begin(), scopeResults.end(), [name](const scope_result& r){ return r.name == name; });
+        return it == scopeResults.end() ? nullptr : &*it;
+    }
+
+    bool gpu_profiler::read_results(int frame)
+    {
+        const frame_queries& f = frames[frame];
+        uint32_t count = f.scopes.size();
+        // without eWait the results are eNotReady if any query has not finished yet, the old ones are kept then
+        auto [result, ticks] = device.getQueryPoolResults<uint64_t>(timestampPool.get(), 2*maxScopes*frame, 2*count,
+            2*count*sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if(result != vk::Result::eSuccess)
+            return false;
+        std::vector<uint64_t> counts;
+        if(f.statisticsUsed > 0)
+        {
+            auto [statisticsResult, values] = device.getQueryPoolResults<uint64_t>(statisticsPool.get(), maxScopes*frame, f.statisticsUsed,
+                f.statisticsUsed*statisticCount*sizeof(uint64_t), statisticCount*sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+            if(statisticsResult != vk::Result::eSuccess)
+                return false;
+            counts = std::move(values);
+        }
+
+        // scopes are matched by name, so a pass that is skipped for a frame starts over with its next measurement
+        std::vector<scope_result> updated;
+        updated.reserve(count);
+        for(uint32_t i=0; i<count; i++)
+        {
+            const recorded_scope& s = f.scopes[i];
+            const scope_result* old = find(s.name);
+            scope_result& r = updated.emplace_back(old ? *old : scope_result{});
+            r.name = s.name;
+            r.depth = s.depth;
+            r.lastTime = ((ticks[2*i+1]-ticks[2*i]) & timestampMask) * timestampPeriod / 1.0e6f;
+            r.time = old ? std::lerp(old->time, r.lastTime, smoothing) : r.lastTime;
+            if(s.statistics >= 0)
+            {
+                const uint64_t* c = counts.data() + s.statistics*statisticCount;
+                double weight = old ? smoothing : 1.0;
+                r.vertexInvocations = std::lerp(r.vertexInvocations, (double)c[0], weight);
+                r.fragmentInvocations = std::lerp(r.fragmentInvocations, (double)c[1], weight);
+                r.computeInvocations = std::lerp(r.computeInvocations, (double)c[2], weight);
+            }
+        }
+        scopeResults = std::move(updated);
+        return true;
+    }
+}
@@ -1,5 +1,8 @@
 #include "render/phase.hpp"
 #include "render/window.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
 
 namespace render
 {
@@ -7,7 +10,8 @@ namespace render
         win(window),
         instance(window->instance.get()), device(window->device.get()),
         allocator(window->allocator), loader(window->loader.get()),
-        graphicsQueue(window->graphicsQueue), graphicsFamily(window->queueFamilyIndices.graphicsFamily.value())
+        graphicsQueue(window->graphicsQueue), queueMutex(&window->queueMutex), graphicsFamily(window->queueFamilyIndices.graphicsFamily.value()),
+        pipelineCache(window->pipelineCache.get())
     {
 
     }
@@ -30,12 +34,43 @@ namespace render
         }
     }
 
+    bool phase::isLoaded() const
+    {
+        return std::all_of(loadingFutures.begin(), loadingFutures.end(), [](const auto& f){
+            return utils::is_ready(f);
+        });
+    }
+
+    vk::UniquePipeline phase::createPipeline(const vk::GraphicsPipelineCreateInfo& info)
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        vk::UniquePipeline pipeline = device.createGraphicsPipelineUnique(pipelineCache, info).value;
+        pipelineTime += std::chrono::high_resolution_clock::now() - t0;
+        return pipeline;
+    }
+
+    std::vector<vk::UniquePipeline> phase::createPipelines(vk::ArrayProxy<const vk::GraphicsPipelineCreateInfo> infos)
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<vk::UniquePipeline> pipelines = device.createGraphicsPipelinesUnique(pipelineCache, infos).value;
+        pipelineTime += std::chrono::high_resolution_clock::now() - t0;
+        return pipelines;
+    }
+
+    vk::UniquePipeline phase::createPipeline(const vk::ComputePipelineCreateInfo& info)
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        vk::UniquePipeline pipeline = device.createComputePipelineUnique(pipelineCache, info).value;
+        pipelineTime += std::chrono::high_resolution_clock::now() - t0;
+        return pipeline;
+    }
+
     void phase::init()
     {
 
     }
 
-    void phase::render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
+    void phase::render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
     {
 
     }
@@ -3,6 +3,7 @@
 #include "render/window.hpp"
 #include "render/debug.hpp"
 #include "render/utils.hpp"
+#include "config.hpp"
 #include "utils.hpp"
 
 #include <chrono>
@@ -11,6 +12,8 @@
 #include <freetype2/ft2build.h>
 #include <freetype/freetype.h>
 
+using namespace config;
+
 namespace render::phases
 {
     loading_screen::loading_screen(window* window) : phase(window)
@@ -21,12 +24,20 @@ namespace render::phases
     {
         FT_Library ft;
         FT_Error err = FT_Init_FreeType(&ft);
-        font = std::make_unique<font_renderer>("/usr/share/fonts/liberation/LiberationSans-Regular.ttf", 128, device, allocator);
+        font = std::make_unique<font_renderer>(CONFIG.fontFile, 128, device, allocator);
 
         pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, graphicsFamily));
 
-        background = std::make_unique<texture>(device, allocator, 1920, 1080, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc);
-        loader->loadTexture(background.get(), "loading_screen/background.png");
+        background = std::make_unique<texture>(device, allocator, resource_loader::getImageSize("loading_screen/background.png"),
+            vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc);
+        background->name("Loading Screen Background");
+        backgroundReady = loader->loadTexture(background.get(), "loading_screen/background.png");
+
+        sampler = device.createSamplerUnique(vk::SamplerCreateInfo(
+            {}, vk::Filter::eLinear, vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueBlack));
 
         vk::AttachmentDescription attachment({}, win->swapchainFormat.format, vk::SampleCountFlagBits::e1,
             vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
@@ -42,7 +53,26 @@ namespace render::phases
         debugName(device, renderPass.get(), "Loading Screen Render Pass");
 
         {
-            vk::PipelineLayoutCreateInfo layout_info({}, {}, {});
+            vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, binding);
+            descriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, descriptorLayout.get(), "Loading Screen Descriptor Layout");
+        }
+        {
+            vk::DescriptorPoolSize size(vk::DescriptorType::eCombinedImageSampler, 1);
+            vk::DescriptorPoolCreateInfo pool_info({}, 1, size);
+            descriptorPool = device.createDescriptorPoolUnique(pool_info);
+
+            vk::DescriptorSetAllocateInfo set_info(descriptorPool.get(), descriptorLayout.get());
+            descriptorSet = device.allocateDescriptorSets(set_info).front();
+
+            vk::DescriptorImageInfo image_info(sampler.get(), background->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::WriteDescriptorSet write(descriptorSet, 0, 0, vk::DescriptorType::eCombinedImageSampler, image_info);
+            device.updateDescriptorSets(write, {});
+        }
+        {
+            vk::PushConstantRange range(vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushConstants));
+            vk::PipelineLayoutCreateInfo layout_info({}, descriptorLayout.get(), range);
             pipelineLayout = device.createPipelineLayoutUnique(layout_info);
             debugName(device, pipelineLayout.get(), "Loading Screen Pipeline Layout");
         }
@@ -75,17 +105,18 @@ namespace render::phases
 
             vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
                 &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, pipelineLayout.get(), renderPass.get());
-            pipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
+            pipeline = createPipeline(pipeline_info);
             debugName(device, pipeline.get(), "Loading Screen Pipeline");
         }
 
-        font->preload(ft, loader, renderPass.get());
+        font->preload(ft, loader, renderPass.get(), pipelineCache);
+        pipelineTime += font->pipelineTime;
     }
 
     void loading_screen::prepare(std::vector<vk::Image> swapchainImages, std::vector<vk::ImageView> swapchainViews)
     {
         commandBuffers = device.allocateCommandBuffersUnique(
-            vk::CommandBufferAllocateInfo(pool.get(), vk::CommandBufferLevel::ePrimary, swapchainImages.size()));
+            vk::CommandBufferAllocateInfo(pool.get(), vk::CommandBufferLevel::ePrimary, win->framesInFlight));
         this->swapchainImages = swapchainImages;
 
         for(int i=0; i<swapchainViews.size(); i++)
@@ -94,10 +125,10 @@ namespace render::phases
                 win->swapchainExtent.width, win->swapchainExtent.height, 1);
             framebuffers.push_back(device.createFramebufferUnique(framebuffer_info));
             debugName(device, framebuffers.back().get(), "Loading Screen Framebuffer #"+std::to_string(i));
-
-            debugName(device, commandBuffers[i].get(), "Loading Screen Command Buffer #"+std::to_string(i));
         }
-        font->prepare(swapchainViews.size());
+        for(int i=0; i<commandBuffers.size(); i++)
+            debugName(device, commandBuffers[i].get(), "Loading Screen Command Buffer #"+std::to_string(i));
+        font->prepare(win->framesInFlight);
     }
 
     void loading_screen::submitLoadingPoint(LoadingPoint p)
@@ -105,7 +136,13 @@ namespace render::phases
         loadingPoints.push_back(p);
     }
 
-    void loading_screen::render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
+    void loading_screen::reset()
+    {
+        loadingPoints.clear();
+        baseline = loader->progress();
+    }
+
+    void loading_screen::render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
     {
         for(auto& p : loadingPoints)
         {
@@ -114,37 +151,51 @@ namespace render::phases
                 p.done = true;
             }
         }
-
-        auto donePoints = std::count_if(loadingPoints.begin(), loadingPoints.end(), [](auto p){
-            return p.done;
+        auto pending = std::find_if(loadingPoints.begin(), loadingPoints.end(), [](const auto& p){
+            return !p.done;
         });
-        auto totalPoints = loadingPoints.size();
 
-        auto time = std::chrono::high_resolution_clock::now().time_since_epoch();
-        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time);
-        auto partialSeconds = std::chrono::duration<float>(time-seconds);
+        LoaderProgress progress = loader->progress();
+        size_t assetsTotal = progress.tasksQueued - baseline.tasksQueued;
+        size_t assetsDone = progress.tasksCompleted - baseline.tasksCompleted;
+        size_t bytesTotal = progress.bytesQueued - baseline.bytesQueued;
+        size_t bytesDone = progress.bytesCompleted - baseline.bytesCompleted;
+
+        PushConstants constants{};
+        if(bytesTotal > 0)
+            constants.progress = static_cast<float>(bytesDone) / bytesTotal;
+        else if(assetsTotal > 0)
+            constants.progress = static_cast<float>(assetsDone) / assetsTotal;
 
         vk::UniqueCommandBuffer& commandBuffer = commandBuffers[frame];
 
         commandBuffer->begin(vk::CommandBufferBeginInfo());
 
-        vk::ClearValue color(std::array<float, 4>{partialSeconds.count(), 0.5f, 0.0f, 1.0f});
-        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(renderPass.get(), framebuffers[frame].get(),
+        vk::ClearValue color(std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f});
+        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(renderPass.get(), framebuffers[image].get(),
             vk::Rect2D({0, 0}, win->swapchainExtent), color), vk::SubpassContents::eInline);
-        commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.get());
 
         vk::Viewport viewport(0.0f, 0.0f, win->swapchainExtent.width, win->swapchainExtent.height, 0.0f, 1.0f);
         vk::Rect2D scissor({0,0}, win->swapchainExtent);
         commandBuffer->setViewport(0, viewport);
         commandBuffer->setScissor(0, scissor);
 
-        vk::DebugUtilsLabelEXT label("Test!", std::array<float, 4>{1.0f, 0.5f, 0.0f, 1.0f});
-        commandBuffer->insertDebugUtilsLabelEXT(label);
-        commandBuffer->draw(3, 1, 0, 0);
+        if(utils::has_succeeded(backgroundReady))
+        {
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.get());
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, descriptorSet, {});
+            commandBuffer->pushConstants<PushConstants>(pipelineLayout.get(), vk::ShaderStageFlagBits::eFragment, 0, constants);
+            commandBuffer->draw(3, 1, 0, 0);
+        }
 
-        font->renderText(commandBuffer.get(), frame, "FPS: "+std::to_string(win->currentFPS), 0, 0, 0.05f, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        font->renderText(commandBuffer.get(), frame, "MOIN MOIN", 1, 0, 0.1f, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        font->renderText(commandBuffer.get(), frame, std::to_string(donePoints)+"/"+std::to_string(totalPoints), 0, 0.1, 0.1f, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+        std::string status = pending == loadingPoints.end() ? "Loading assets" : pending->name;
+        std::string assets = std::to_string(assetsDone)+"/"+std::to_string(assetsTotal)+" assets, "
+            +utils::to_fixed_string<1>(bytesDone/(1024.0*1024.0))+"/"+utils::to_fixed_string<1>(bytesTotal/(1024.0*1024.0))+" MiB";
+        if(size_t failed = progress.tasksFailed - baseline.tasksFailed; failed > 0)
+            assets += ", "+std::to_string(failed)+" failed";
+        font->renderText(commandBuffer.get(), frame, "FPS: "+utils::to_fixed_string<1>(win->currentFPS), 0.05f, 0.05f, 0.05f);
+        font->renderText(commandBuffer.get(), frame, status, 0.2f, 1.65f, 0.08f);
+        font->renderText(commandBuffer.get(), frame, assets, 0.2f, 1.73f, 0.05f, glm::vec4(0.8f, 0.8f, 0.8f, 1.0f));
         font->finish(frame);
 
         commandBuffer->endRenderPass();
@@ -152,6 +203,7 @@ namespace render::phases
 
         vk::PipelineStageFlags waitFlags = vk::PipelineStageFlagBits::eColorAttachmentOutput;
         vk::SubmitInfo submit_info(imageAvailable, waitFlags, commandBuffer.get(), renderFinished);
+        std::scoped_lock<std::mutex> l(*queueMutex);
         graphicsQueue.submit(submit_info, fence);
     }
 }
@@ -5,8 +5,17 @@
 #include "render/utils.hpp"
 #include "render/debug.hpp"
 #include "config.hpp"
+#include "utils.hpp"
 #include "entity/components/renderable.hpp"
 #include "entity/components/rotation.hpp"
+#include "entity/scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <tuple>
 
 #define GLM_FORCE_RADIANS
 #include <glm/gtc/matrix_transform.hpp>
@@ -20,17 +29,44 @@ namespace render::phases
     render_test::render_test(window* window, entt::registry& entities, std::function<void(gui_render_context&)> guiRenderCallback) : phase(window), entities(entities), guiRenderCallback(guiRenderCallback)
     {
         lightView = entities.view<const entity::components::position, const entity::components::light>();
-        modelView = entities.view<const entity::components::position, const entity::components::model>();
-        hitboxView = entities.view<const entity::components::position, const entity::components::model, entity::components::collision>();
+        renderGroup = entities.group<entity::components::position, entity::components::model, entity::components::renderable>();
     }
 
     render_test::~render_test()
     {
+        entities.on_construct<entity::components::model>().disconnect(this);
+        entities.on_update<entity::components::model>().disconnect(this);
+        entities.on_update<entity::components::position>().disconnect(this);
+        entities.on_update<entity::components::rotation>().disconnect(this);
+        entities.on_update<entity::components::light>().disconnect(this);
+        entities.on_construct<entity::components::renderable>().disconnect(this);
+        entities.on_update<entity::components::renderable>().disconnect(this);
+        entities.on_destroy<entity::components::renderable>().disconnect(this);
+
+        // assets might still be streaming in, the loader must not write into freed objects
+        for(auto& [name, asset] : textures)
+        {
+            if(asset.future.valid())
+                asset.future.wait();
+        }
+        for(auto& [name, asset] : models)
+        {
+            if(asset.future.valid())
+                asset.future.wait();
+        }
+        if(placeholderTexture.future.valid())
+            placeholderTexture.future.wait();
+
         for(int i=0; i<lightUniformPointers.size(); i++)
         {
             allocator.unmapMemory(lightUniformAllocations[i]);
             allocator.destroyBuffer(lightUniformBuffers[i], lightUniformAllocations[i]);
         }
+        for(int i=0; i<lightStoragePointers.size(); i++)
+        {
+            allocator.unmapMemory(lightStorageAllocations[i]);
+            allocator.destroyBuffer(lightStorageBuffers[i], lightStorageAllocations[i]);
+        }
         for(int i=0; i<globalUniformPointers.size(); i++)
         {
             allocator.unmapMemory(globalUniformAllocations[i]);
@@ -41,26 +77,214 @@ namespace render::phases
             allocator.unmapMemory(globalShadowUniformAllocations[i]);
             allocator.destroyBuffer(globalShadowUniformBuffers[i], globalShadowUniformAllocations[i]);
         }
-        for(int i=0; i<modelUniformPointers.size(); i++)
+        for(int i=0; i<objectCapacity.size(); i++)
         {
-            allocator.unmapMemory(modelUniformAllocations[i]);
-            allocator.destroyBuffer(modelUniformBuffers[i], modelUniformAllocations[i]);
+            free_object_buffers(i);
+        }
+        for(int i=0; i<cullViewPointers.size(); i++)
+        {
+            allocator.unmapMemory(cullViewAllocations[i]);
+            allocator.destroyBuffer(cullViewBuffers[i], cullViewAllocations[i]);
         }
     }
 
     void render_test::preload()
     {
+        // all shadow maps are drawn in one pass, each instance selects its layer
+        shaderLayer = win->enabledDeviceExtensions.contains(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+        std::vector<std::string> shaderFiles = {
+            "test/render.vert", "test/render.frag", "test/shadow.frag",
+            "test/hitbox.vert", "test/hitbox.frag",
+            "test/shade.vert", "test/shade.frag", "test/upscale.frag",
+            "test/cull.comp"
+        };
+        if(shaderLayer)
+            shaderFiles.push_back("test/shadow_layer.vert");
+        else
+            shaderFiles.insert(shaderFiles.end(), {"test/shadow.vert", "test/shadow.geom"});
+        tiledLighting = CONFIG.tiledLighting;
+        depthPrepass = CONFIG.depthPrepass;
+        if(depthPrepass)
+            shaderFiles.push_back("test/depth.vert");
+        if(tiledLighting)
+            shaderFiles.insert(shaderFiles.end(), {"test/light.comp", "test/compose.frag"});
+        else
+            shaderFiles.push_back("test/ambient.frag");
+
+        // reading and creating the shader modules overlaps with everything below
+        auto shaderModules = createShaders(device, shaderFiles);
+
+        // firstInstance in indirect draws is what places every batch in its part of the instance buffer
+        gpuCulling = CONFIG.gpuCulling && win->deviceFeatures.drawIndirectFirstInstance;
+        drawIndirectCount = win->deviceFeatures12.drawIndirectCount;
+        if(CONFIG.gpuCulling && !gpuCulling)
+            spdlog::warn("[Render Test] drawIndirectFirstInstance is not supported, culling on the CPU instead");
+        spdlog::info("[Render Test] Culling on the {}{}", gpuCulling ? "GPU" : "CPU",
+            gpuCulling && !drawIndirectCount ? " without drawIndexedIndirectCount" : "");
+
+        // octahedral normals fit in two channels, the position is reconstructed from the depth buffer,
+        // an integer format because averaging encodings from both sides of the octahedral fold gives a wrong normal,
+        // integer attachments are resolved by taking one sample instead, like the depth
+        normalFormat = vk::Format::eR16G16Sint;
+
         pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, graphicsFamily));
 
         {
+            std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex),
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex),
+            };
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
+            mainDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, mainDescriptorLayout.get(), "Render Test Main Descriptor Layout");
+        }
+        {
+            std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment),
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment),
+                vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eFragment),
+                vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment)
+            };
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
+            shadeDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, shadeDescriptorLayout.get(), "Render Test Shading Descriptor Layout");
+        }
+        {
+            std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute),
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute) // matrices of every layer
+            };
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
+            shadowMapDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, shadowMapDescriptorLayout.get(), "Render Test Shadow Map Descriptor Layout");
+        }
+        {
+            vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, binding);
+            upscaleDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, upscaleDescriptorLayout.get(), "Render Test Upscale Descriptor Layout");
+        }
+        if(tiledLighting)
+        {
+            std::array<vk::DescriptorSetLayoutBinding, 5> bindings = {
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute), // color
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute), // normal
+                vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute), // depth
+                vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eFragment), // lit
+                vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // lights
+            };
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
+            lightingDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, lightingDescriptorLayout.get(), "Render Test Lighting Descriptor Layout");
+        }
+        {
+            const auto& features = win->deviceFeatures12;
+            if(!features.runtimeDescriptorArray || !features.shaderSampledImageArrayNonUniformIndexing ||
+                !features.descriptorBindingPartiallyBound || !features.descriptorBindingSampledImageUpdateAfterBind)
+            {
+                spdlog::error("[Render Test] Video device does not support descriptor indexing for sampled images");
+                throw std::runtime_error("descriptor indexing not supported");
+            }
+
+            auto limits = win->physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>()
+                .get<vk::PhysicalDeviceVulkan12Properties>();
+            textureSlotLimit = std::min({maxTextures,
+                limits.maxPerStageDescriptorUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxDescriptorSetUpdateAfterBindSampledImages});
+
+            // textures are written into the array while earlier frames using it may still be pending
+            vk::DescriptorBindingFlags bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+            vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_info(bindingFlags);
+            vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, textureSlotLimit, vk::ShaderStageFlagBits::eFragment);
+            vk::DescriptorSetLayoutCreateInfo layout_info(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, binding);
+            layout_info.setPNext(&flags_info);
+            textureDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, textureDescriptorLayout.get(), "Render Test Texture Descriptor Layout");
+
+            vk::DescriptorPoolSize size(vk::DescriptorType::eCombinedImageSampler, textureSlotLimit);
+            vk::DescriptorPoolCreateInfo pool_info(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, size);
+            textureDescriptorPool = device.createDescriptorPoolUnique(pool_info);
+            debugName(device, textureDescriptorPool.get(), "Render Test Texture Descriptor Pool");
+
+            textureDescriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(textureDescriptorPool.get(), textureDescriptorLayout.get())).front();
+            debugName(device, textureDescriptorSet, "Render Test Texture Descriptor Set");
+        }
+        {
+            std::array<vk::DescriptorSetLayoutBinding, 6> bindings = {
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // models
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // objects
+                vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // draw commands
+                vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // draw counts
+                vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // instances
+                vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute), // views
+            };
+            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
+            cullDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
+            debugName(device, cullDescriptorLayout.get(), "Render Test Culling Descriptor Layout");
+        }
+
+        shadowSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
+            {}, vk::Filter::eLinear, vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToBorder, vk::SamplerAddressMode::eClampToBorder, vk::SamplerAddressMode::eClampToBorder,
+            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
+        textureSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
+            {}, vk::Filter::eLinear, vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat,
+            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
+        gbufferSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
+            {}, vk::Filter::eNearest, vk::Filter::eNearest,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
+        upscaleSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
+            {}, vk::Filter::eLinear, vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
+
+        // tiny checkerboard that is drawn until the real texture of an entity has finished loading
+        placeholderTexture.tex = std::make_unique<texture>(device, allocator, 2, 2);
+        placeholderTexture.tex->name("Render Test Placeholder Texture");
+        placeholderTexture.slot = allocate_texture_slot(*placeholderTexture.tex);
+        placeholderTexture.future = loader->loadTexture(placeholderTexture.tex.get(), [](uint8_t* p, size_t size){
+            uint32_t* image = (uint32_t*)p;
+            image[0] = image[3] = 0xff808080;
+            image[1] = image[2] = 0xff404040;
+        });
+
+        // only load what the scene actually uses, entities created later request their assets themselves
+        for(auto [e, m] : entities.view<const entity::components::model>().each())
+        {
+            request_model(m.model_name);
+            request_texture(m.texture_name);
+        }
+        entities.on_construct<entity::components::model>().connect<&render_test::request_assets>(this);
+        entities.on_update<entity::components::model>().connect<&render_test::request_assets>(this);
+
+        // shadow maps are only drawn again when something they show changed
+        entities.on_update<entity::components::model>().connect<&render_test::mark_changed>(this);
+        entities.on_update<entity::components::position>().connect<&render_test::mark_changed>(this);
+        entities.on_update<entity::components::rotation>().connect<&render_test::mark_changed>(this);
+        entities.on_update<entity::components::light>().connect<&render_test::mark_changed>(this);
+        entities.on_construct<entity::components::renderable>().connect<&render_test::mark_changed>(this);
+        entities.on_update<entity::components::renderable>().connect<&render_test::mark_changed>(this);
+        entities.on_destroy<entity::components::renderable>().connect<&render_test::mark_changed>(this);
+
+        {
+            // layers that are not drawn keep their content, the drawn ones are cleared by record_shadow()
             vk::AttachmentDescription shadowAttachment({}, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1,
-                vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
+                vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore,
                 vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-                vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+                vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
             vk::AttachmentReference ref(0, vk::ImageLayout::eDepthStencilAttachmentOptimal);
             vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, 0, {}, 0, {}, 0, &ref, 0, {});
-            std::array<vk::SubpassDependency, 1> dependencies = {
-                vk::SubpassDependency(0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eLateFragmentTests, vk::PipelineStageFlagBits::eFragmentShader,
+            std::array<vk::SubpassDependency, 2> dependencies = {
+                vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+                    vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                    {}, vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+                vk::SubpassDependency(0, VK_SUBPASS_EXTERNAL, vk::PipelineStageFlagBits::eLateFragmentTests, vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
                     vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::AccessFlagBits::eShaderRead)
             };
 
@@ -70,80 +294,96 @@ namespace render::phases
             debugName(device, shadowRenderPass.get(), "Render Test Shadow Render Pass");
         }
         {
-            std::array<vk::AttachmentDescription, 5> attachments = {
-        /*0*/    vk::AttachmentDescription({}, vk::Format::eR8G8B8A8Srgb, CONFIG.sampleCount, // color
+            // RenderPass2 for the depth resolve, which is core since Vulkan 1.2 and always supports sample zero
+            std::array<vk::AttachmentDescription2, 6> attachments = {
+        /*0*/    vk::AttachmentDescription2({}, vk::Format::eR8G8B8A8Srgb, CONFIG.sampleCount, // color
                     vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eDontCare,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral),
-        /*1*/    vk::AttachmentDescription({}, vk::Format::eR32G32B32A32Sfloat, CONFIG.sampleCount, // shade
+        /*1*/    vk::AttachmentDescription2({}, normalFormat, CONFIG.sampleCount, // shade
                     vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eDontCare,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral),
-        /*2*/    vk::AttachmentDescription({}, vk::Format::eD32Sfloat, CONFIG.sampleCount, // depth
+        /*2*/    vk::AttachmentDescription2({}, vk::Format::eD32Sfloat, CONFIG.sampleCount, // depth
                     vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eDontCare,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral),
 
-        /*3*/    vk::AttachmentDescription({}, vk::Format::eR8G8B8A8Srgb, vk::SampleCountFlagBits::e1, // color revolve
+        /*3*/    vk::AttachmentDescription2({}, vk::Format::eR8G8B8A8Srgb, vk::SampleCountFlagBits::e1, // color revolve
+                    vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eStore,
+                    vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+                    vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal),
+        /*4*/    vk::AttachmentDescription2({}, normalFormat, vk::SampleCountFlagBits::e1, // shade revolve
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eStore,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal),
-        /*4*/    vk::AttachmentDescription({}, vk::Format::eR32G32B32A32Sfloat, vk::SampleCountFlagBits::e1, // shade revolve
+        /*5*/    vk::AttachmentDescription2({}, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1, // depth revolve
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eStore,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal),
             };
 
-            vk::AttachmentReference colorWriteRef(0, vk::ImageLayout::eColorAttachmentOptimal);
-            vk::AttachmentReference shadingWriteRef(1, vk::ImageLayout::eColorAttachmentOptimal);
-            vk::AttachmentReference depthRef(2, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+            vk::AttachmentReference2 colorWriteRef(0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+            vk::AttachmentReference2 shadingWriteRef(1, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+            vk::AttachmentReference2 depthRef(2, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth);
 
-            vk::AttachmentReference colorReadRef(3, vk::ImageLayout::eShaderReadOnlyOptimal);
-            vk::AttachmentReference shadingReadRef(4, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::AttachmentReference2 colorRevolveRef(3, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+            vk::AttachmentReference2 shadeRevolveRef(4, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+            vk::AttachmentReference2 depthRevolveRef(5, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth);
 
-            vk::AttachmentReference colorRevolveRef(3, vk::ImageLayout::eColorAttachmentOptimal);
-            vk::AttachmentReference shadeRevolveRef(4, vk::ImageLayout::eColorAttachmentOptimal);
+            std::array<vk::AttachmentReference2, 2> pass1Refs = {colorWriteRef, shadingWriteRef};
+            // the shade revolve takes a single sample of the normals, see normalFormat
+            std::array<vk::AttachmentReference2, 2> pass1Revolve = {colorRevolveRef, shadeRevolveRef};
+            vk::SubpassDescriptionDepthStencilResolve depthResolve(vk::ResolveModeFlagBits::eSampleZero, vk::ResolveModeFlagBits::eNone, &depthRevolveRef);
+            vk::SubpassDescription2 subpass({}, vk::PipelineBindPoint::eGraphics, 0, {}, pass1Refs, pass1Revolve, &depthRef, {});
+            subpass.pNext = &depthResolve;
 
-            std::array<vk::AttachmentReference, 2> pass1Refs = {colorWriteRef, shadingWriteRef};
-            std::array<vk::AttachmentReference, 2> pass1Revolve = {colorRevolveRef, shadeRevolveRef};
-            vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, {}, pass1Refs, pass1Revolve, &depthRef, {});
-
-            std::array<vk::SubpassDependency, 2> dependencies = {
-                vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0,
+            std::array<vk::SubpassDependency2, 2> dependencies = {
+                vk::SubpassDependency2(VK_SUBPASS_EXTERNAL, 0,
                     vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
                     vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
                     {}, vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
-                vk::SubpassDependency(0, VK_SUBPASS_EXTERNAL,
-                    vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
-                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                    vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead)
+                // resolves happen in the color attachment output stage, the shading pass reads them as input attachments
+                // and tiled lighting samples them in a compute shader
+                vk::SubpassDependency2(0, VK_SUBPASS_EXTERNAL,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+                    vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                    vk::AccessFlagBits::eInputAttachmentRead | vk::AccessFlagBits::eShaderRead)
             };
-            vk::RenderPassCreateInfo renderpass_info({}, attachments, subpass, dependencies);
+            vk::RenderPassCreateInfo2 renderpass_info({}, attachments, subpass, dependencies);
 
-            mainRenderPass = device.createRenderPassUnique(renderpass_info);
+            mainRenderPass = device.createRenderPass2Unique(renderpass_info);
             debugName(device, mainRenderPass.get(), "Render Test Main Render Pass");
         }
         {
-            std::array<vk::AttachmentDescription, 3> attachments = {
+            std::array<vk::AttachmentDescription, 4> attachments = {
         /*0*/    vk::AttachmentDescription({}, vk::Format::eR8G8B8A8Srgb, vk::SampleCountFlagBits::e1, // color
                     vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eDontCare,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eGeneral),
-        /*1*/    vk::AttachmentDescription({}, vk::Format::eR32G32B32A32Sfloat, vk::SampleCountFlagBits::e1, // shade
+        /*1*/    vk::AttachmentDescription({}, normalFormat, vk::SampleCountFlagBits::e1, // shade
+                    vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eDontCare,
+                    vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+                    vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eGeneral),
+        /*2*/    vk::AttachmentDescription({}, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1, // depth
                     vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eDontCare,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eGeneral),
-        /*2*/    vk::AttachmentDescription({}, win->swapchainFormat.format, vk::SampleCountFlagBits::e1, // final
+        /*3*/    vk::AttachmentDescription({}, sceneFormat, vk::SampleCountFlagBits::e1, // scene, upscaled into the swapchain image
                     vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
                     vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-                    vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR)
+                    vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal)
             };
             vk::AttachmentReference colorReadRef(0, vk::ImageLayout::eShaderReadOnlyOptimal);
             vk::AttachmentReference shadingReadRef(1, vk::ImageLayout::eShaderReadOnlyOptimal);
-            vk::AttachmentReference finalWriteRef(2, vk::ImageLayout::eColorAttachmentOptimal);
+            // the depth is read and also tested against, so that the lights skip pixels nothing was drawn on
+            vk::AttachmentReference depthReadRef(2, vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+            vk::AttachmentReference finalWriteRef(3, vk::ImageLayout::eColorAttachmentOptimal);
 
-            std::array<vk::AttachmentReference, 2> pass1In = {colorReadRef, shadingReadRef};
-            vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, pass1In, finalWriteRef, {}, nullptr, {});
+            std::array<vk::AttachmentReference, 3> pass1In = {colorReadRef, shadingReadRef, depthReadRef};
+            vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, pass1In, finalWriteRef, {}, &depthReadRef, {});
 
             std::array<vk::SubpassDependency, 2> dependencies = {
                 vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0,
@@ -152,14 +392,36 @@ namespace render::phases
                     {}, vk::AccessFlagBits::eColorAttachmentWrite),
                 vk::SubpassDependency(0, VK_SUBPASS_EXTERNAL,
                     vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                    vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead)
+                    vk::PipelineStageFlagBits::eFragmentShader,
+                    vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eShaderRead)
             };
             vk::RenderPassCreateInfo renderpass_info({}, attachments, subpass, dependencies);
 
             shadeRenderPass = device.createRenderPassUnique(renderpass_info);
             debugName(device, shadeRenderPass.get(), "Render Test Shade Render Pass");
         }
+        {
+            // every pixel is written, so the old content of the swapchain image does not matter
+            vk::AttachmentDescription attachment({}, win->swapchainFormat.format, vk::SampleCountFlagBits::e1,
+                vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eStore,
+                vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+                vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR);
+            vk::AttachmentReference ref(0, vk::ImageLayout::eColorAttachmentOptimal);
+            std::array<vk::SubpassDependency, 2> dependencies = {
+                vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    {}, vk::AccessFlagBits::eColorAttachmentWrite),
+                vk::SubpassDependency(0, VK_SUBPASS_EXTERNAL,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead)
+            };
+            vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, {}, ref);
+            vk::RenderPassCreateInfo renderpass_info({}, attachment, subpass, dependencies);
+            upscalePass = device.createRenderPassUnique(renderpass_info);
+            debugName(device, upscalePass.get(), "Render Test Upscale Render Pass");
+        }
         {
             vk::AttachmentDescription attachment({}, win->swapchainFormat.format, vk::SampleCountFlagBits::e1,
                 vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore,
@@ -175,41 +437,12 @@ namespace render::phases
             debugName(device, overlayPass.get(), "Render Test Overlay Render Pass");
         }
 
-        {
-            std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
-                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex),
-                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex),
-            };
-            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
-            mainDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
-            debugName(device, mainDescriptorLayout.get(), "Render Test Main Descriptor Layout");
-        }
-        {
-            std::array<vk::DescriptorSetLayoutBinding, 3> bindings = {
-                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment),
-                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment),
-                vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eFragment)
-            };
-            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
-            shadeDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
-            debugName(device, shadeDescriptorLayout.get(), "Render Test Shading Descriptor Layout");
-        }
-        {
-            std::array<vk::DescriptorSetLayoutBinding, 1> bindings = {
-                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-            };
-            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
-            shadowMapDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
-            debugName(device, shadowMapDescriptorLayout.get(), "Render Test Shadow Map Descriptor Layout");
-        }
-        {
-            std::array<vk::DescriptorSetLayoutBinding, 1> bindings = {
-                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-            };
-            vk::DescriptorSetLayoutCreateInfo layout_info({}, bindings);
-            textureDescriptorLayout = device.createDescriptorSetLayoutUnique(layout_info);
-            debugName(device, textureDescriptorLayout.get(), "Render Test Texture Descriptor Layout");
-        }
+        FT_Library ft;
+        FT_Error err = FT_Init_FreeType(&ft);
+        font = std::make_unique<font_renderer>(CONFIG.fontFile, 128, device, allocator);
+        auto fontReady = std::async(std::launch::async, [this, ft](){
+            font->preload(ft, loader, overlayPass.get(), pipelineCache);
+        });
 
         {
             std::array<vk::DescriptorSetLayout, 2> layouts = {
@@ -228,190 +461,269 @@ namespace render::phases
             debugName(device, shadePipelineLayout.get(), "Render Test Shade Pipeline Layout");
         }
         {
+            vk::PushConstantRange range(vk::ShaderStageFlagBits::eFragment, 0, sizeof(UpscalePush));
+            vk::PipelineLayoutCreateInfo layout_info({}, upscaleDescriptorLayout.get(), range);
+            upscalePipelineLayout = device.createPipelineLayoutUnique(layout_info);
+            debugName(device, upscalePipelineLayout.get(), "Render Test Upscale Pipeline Layout");
+        }
+        if(tiledLighting)
+        {
+            std::array<vk::DescriptorSetLayout, 2> layouts = {
+                lightingDescriptorLayout.get(), shadowMapDescriptorLayout.get()
+            };
+            vk::PushConstantRange range(vk::ShaderStageFlagBits::eCompute, 0, sizeof(LightingPush));
+            vk::PipelineLayoutCreateInfo layout_info({}, layouts, range);
+            lightingPipelineLayout = device.createPipelineLayoutUnique(layout_info);
+            debugName(device, lightingPipelineLayout.get(), "Render Test Lighting Pipeline Layout");
+        }
+        {
+            vk::PushConstantRange range(vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t)); // object count
+            vk::PipelineLayoutCreateInfo layout_info({}, cullDescriptorLayout.get(), range);
+            cullPipelineLayout = device.createPipelineLayoutUnique(layout_info);
+            debugName(device, cullPipelineLayout.get(), "Render Test Culling Pipeline Layout");
+        }
+        {
+            shader_map shaders = shaderModules.get();
+            auto stages = [&shaders](std::string vertex, std::string fragment){
+                return std::array<vk::PipelineShaderStageCreateInfo, 2>{
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, shaders.at(vertex).get(), "main"),
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, shaders.at(fragment).get(), "main")
+                };
+            };
+
             vk::PipelineInputAssemblyStateCreateInfo input_assembly({}, vk::PrimitiveTopology::eTriangleList);
+            vk::PipelineInputAssemblyStateCreateInfo line_assembly({}, vk::PrimitiveTopology::eLineList);
             vk::PipelineTessellationStateCreateInfo tesselation({}, {});
 
             vk::Viewport v{};
             vk::Rect2D s{};
             vk::PipelineViewportStateCreateInfo viewport({}, v, s);
 
-            vk::PipelineRasterizationStateCreateInfo rasterization({}, false, false, vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 1.0f);
-
             std::array<vk::DynamicState, 2> dynamicStates{vk::DynamicState::eViewport, vk::DynamicState::eScissor};
             vk::PipelineDynamicStateCreateInfo dynamic({}, dynamicStates);
 
-            {
-                vk::VertexInputBindingDescription inputBinding(0, sizeof(vertex_data), vk::VertexInputRate::eVertex);
-                auto inputAttributes = vertex_data::attributes(0);
-                vk::PipelineVertexInputStateCreateInfo vertex_input({}, inputBinding, inputAttributes);
+            // binding 1 holds the model buffer index of every instance, written per pass after culling
+            std::array<vk::VertexInputBindingDescription, 2> inputBindings = {
+                vk::VertexInputBindingDescription(0, sizeof(vertex_data), vk::VertexInputRate::eVertex),
+                vk::VertexInputBindingDescription(1, sizeof(uint32_t), vk::VertexInputRate::eInstance)
+            };
+            auto vertexAttributes = vertex_data::attributes(0);
+            std::array<vk::VertexInputAttributeDescription, 4> inputAttributes = {
+                vertexAttributes[0], vertexAttributes[1], vertexAttributes[2],
+                vk::VertexInputAttributeDescription(3, 1, vk::Format::eR32Uint, 0)
+            };
+            vk::PipelineVertexInputStateCreateInfo model_input({}, inputBindings, inputAttributes);
+            vk::PipelineVertexInputStateCreateInfo empty_input({}, {}, {});
 
-                vk::UniqueShaderModule vertexShader = createShader(device, "test/render.vert");
-                vk::UniqueShaderModule fragmentShader = createShader(device, "test/render.frag");
-                std::array<vk::PipelineShaderStageCreateInfo, 2> shaders = {
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertexShader.get(), "main"),
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragmentShader.get(), "main")
-                };
+            vk::PipelineMultisampleStateCreateInfo multisample({}, CONFIG.sampleCount);
+            vk::PipelineMultisampleStateCreateInfo singlesample({}, vk::SampleCountFlagBits::e1);
 
-                vk::PipelineDepthStencilStateCreateInfo depthStencil({}, true, true, vk::CompareOp::eLess, false, false);
+            std::array<vk::PipelineColorBlendAttachmentState, 2> mainAttachments = {
+                vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
+                vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
+            };
+            vk::PipelineColorBlendStateCreateInfo mainBlend({}, false, vk::LogicOp::eClear, mainAttachments);
+
+            // main
+            auto mainStages = stages("test/render.vert", "test/render.frag");
+            vk::PipelineRasterizationStateCreateInfo mainRasterization({}, false, false, vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 1.0f);
+            // with the depth pre-pass, render.frag only runs for the fragment that ends up visible
+            vk::PipelineDepthStencilStateCreateInfo mainDepthStencil({}, true, !depthPrepass, depthPrepass ? vk::CompareOp::eEqual : vk::CompareOp::eLess, false, false);
+
+            // depth pre-pass, position only like the shadow pass but in the subpass of the main pass
+            std::array<vk::PipelineShaderStageCreateInfo, 1> prepassStages;
+            if(depthPrepass)
+                prepassStages[0] = vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, shaders.at("test/depth.vert").get(), "main");
+            vk::PipelineDepthStencilStateCreateInfo prepassDepthStencil({}, true, true, vk::CompareOp::eLess, false, false);
+            std::array<vk::PipelineColorBlendAttachmentState, 2> prepassAttachments = {
+                vk::PipelineColorBlendAttachmentState(false).setColorWriteMask({}),
+                vk::PipelineColorBlendAttachmentState(false).setColorWriteMask({})
+            };
+            vk::PipelineColorBlendStateCreateInfo prepassBlend({}, false, vk::LogicOp::eClear, prepassAttachments);
 
-                std::array<vk::PipelineColorBlendAttachmentState, 2> attachments = {
-                    vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
-                    vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
-                };
-                vk::PipelineColorBlendStateCreateInfo colorBlend({}, false, vk::LogicOp::eClear, attachments);
-                vk::PipelineMultisampleStateCreateInfo multisample({}, CONFIG.sampleCount);
+            // hitbox
+            auto hitboxStages = stages("test/hitbox.vert", "test/hitbox.frag");
+            vk::PipelineRasterizationStateCreateInfo hitboxRasterization({}, false, false, vk::PolygonMode::eLine, vk::CullModeFlagBits::eNone, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 5.0f);
+            vk::PipelineDepthStencilStateCreateInfo hitboxDepthStencil({}, true, true, vk::CompareOp::eLessOrEqual, false, false);
 
-                vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
-                    &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, mainPipelineLayout.get(), mainRenderPass.get(), 0);
-                mainPipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
-                debugName(device, mainPipeline.get(), "Render Test Main Pipeline");
-            }
+            // shadow
+            std::vector<vk::PipelineShaderStageCreateInfo> shadowStages;
+            if(shaderLayer)
             {
-                vk::PipelineVertexInputStateCreateInfo vertex_input({}, {}, {});
-                vk::PipelineInputAssemblyStateCreateInfo input_assembly({}, vk::PrimitiveTopology::eLineList);
-
-                vk::UniqueShaderModule vertexShader = createShader(device, "test/hitbox.vert");
-                vk::UniqueShaderModule fragmentShader = createShader(device, "test/hitbox.frag");
-                std::array<vk::PipelineShaderStageCreateInfo, 2> shaders = {
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertexShader.get(), "main"),
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragmentShader.get(), "main")
+                shadowStages = {
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, shaders.at("test/shadow_layer.vert").get(), "main"),
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, shaders.at("test/shadow.frag").get(), "main")
                 };
-
-                vk::PipelineRasterizationStateCreateInfo rasterization({}, false, false, vk::PolygonMode::eLine, vk::CullModeFlagBits::eNone, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 5.0f);
-                vk::PipelineDepthStencilStateCreateInfo depthStencil({}, true, true, vk::CompareOp::eLessOrEqual, false, false);
-
-                std::array<vk::PipelineColorBlendAttachmentState, 2> attachments = {
-                    vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
-                    vk::PipelineColorBlendAttachmentState(false).setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA)
-                };
-                vk::PipelineColorBlendStateCreateInfo colorBlend({}, false, vk::LogicOp::eClear, attachments);
-                vk::PipelineMultisampleStateCreateInfo multisample({}, CONFIG.sampleCount);
-
-                vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
-                    &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, mainPipelineLayout.get(), mainRenderPass.get(), 0);
-                hitboxPipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
-                debugName(device, hitboxPipeline.get(), "Render Test Hitbox Pipeline");
             }
+            else
             {
-                vk::VertexInputBindingDescription inputBinding(0, sizeof(vertex_data), vk::VertexInputRate::eVertex);
-                auto inputAttributes = vertex_data::attributes(0);
-                vk::PipelineVertexInputStateCreateInfo vertex_input({}, inputBinding, inputAttributes);
-
-                vk::UniqueShaderModule vertexShader = createShader(device, "test/render.vert");
-                vk::UniqueShaderModule fragmentShader = createShader(device, "test/shadow.frag");
-                std::array<vk::PipelineShaderStageCreateInfo, 2> shaders = {
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertexShader.get(), "main"),
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragmentShader.get(), "main")
+                shadowStages = {
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, shaders.at("test/shadow.vert").get(), "main"),
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eGeometry, shaders.at("test/shadow.geom").get(), "main"),
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, shaders.at("test/shadow.frag").get(), "main")
                 };
-
-                vk::PipelineRasterizationStateCreateInfo rasterization({}, false, false, vk::PolygonMode::eFill, vk::CullModeFlagBits::eFront, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 1.0f);
-                vk::PipelineMultisampleStateCreateInfo multisample({}, vk::SampleCountFlagBits::e1);
-                vk::PipelineDepthStencilStateCreateInfo depthStencil({}, true, true, vk::CompareOp::eLess, false, false);
-
-                vk::PipelineColorBlendStateCreateInfo colorBlend({}, false, vk::LogicOp::eClear, {});
-
-                vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
-                    &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, mainPipelineLayout.get(), shadowRenderPass.get(), 0);
-                shadowPipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
-                debugName(device, shadowPipeline.get(), "Render Test Shadow Pipeline");
             }
+            vk::PipelineRasterizationStateCreateInfo shadowRasterization({}, false, false, vk::PolygonMode::eFill, vk::CullModeFlagBits::eFront, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 1.0f);
+            vk::PipelineDepthStencilStateCreateInfo shadowDepthStencil({}, true, true, vk::CompareOp::eLess, false, false);
+            vk::PipelineColorBlendStateCreateInfo shadowBlend({}, false, vk::LogicOp::eClear, {});
+
+            // shade
+            auto shadeStages = stages("test/shade.vert", "test/shade.frag");
+            // shade.vert draws at the far plane, which is only further away than pixels with geometry on them
+            vk::PipelineDepthStencilStateCreateInfo shadeDepthStencil({}, true, false, vk::CompareOp::eGreater, false, false);
+            vk::PipelineDepthStencilStateCreateInfo noDepthStencil({}, false, false);
+            vk::PipelineColorBlendAttachmentState shadeAttachment(true, vk::BlendFactor::eOne, vk::BlendFactor::eOne, vk::BlendOp::eAdd);
+            shadeAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+            vk::PipelineColorBlendStateCreateInfo shadeBlend({}, false, vk::LogicOp::eClear, shadeAttachment);
+
+            // upscale
+            auto upscaleStages = stages("test/shade.vert", "test/upscale.frag");
+            vk::PipelineColorBlendAttachmentState upscaleAttachment(false);
+            upscaleAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+            vk::PipelineColorBlendStateCreateInfo upscaleBlend({}, false, vk::LogicOp::eClear, upscaleAttachment);
+
+            // every filter radius with and without shadows, so the variant can be picked per light and frame
+            std::array<vk::SpecializationMapEntry, 2> shadeEntries = {
+                vk::SpecializationMapEntry(0, offsetof(ShadeVariant, pcfRadius), sizeof(ShadeVariant::pcfRadius)),
+                vk::SpecializationMapEntry(1, offsetof(ShadeVariant, shadows), sizeof(ShadeVariant::shadows))
+            };
+            constexpr int shadeVariantCount = 2*(maxFilterRadius+1);
+            std::array<ShadeVariant, shadeVariantCount> shadeVariants;
+            std::array<vk::SpecializationInfo, shadeVariantCount> shadeSpecializations;
+            std::array<std::array<vk::PipelineShaderStageCreateInfo, 2>, shadeVariantCount> shadeVariantStages;
+            for(int i=0; i<shadeVariants.size(); i++)
             {
-                vk::PipelineVertexInputStateCreateInfo vertex_input({}, {}, {});
-
-                vk::UniqueShaderModule vertexShader = createShader(device, "test/shade.vert");
-                vk::UniqueShaderModule fragmentShader = createShader(device, "test/shade.frag");
-                std::array<vk::PipelineShaderStageCreateInfo, 2> shaders = {
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vertexShader.get(), "main"),
-                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, fragmentShader.get(), "main")
-                };
-
-                vk::PipelineDepthStencilStateCreateInfo depthStencil({}, false, false);
-
-                vk::PipelineColorBlendAttachmentState attachment(true, vk::BlendFactor::eOne, vk::BlendFactor::eOne, vk::BlendOp::eAdd);
-                attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-                vk::PipelineColorBlendStateCreateInfo colorBlend({}, false, vk::LogicOp::eClear, attachment);
-                vk::PipelineMultisampleStateCreateInfo multisample({}, vk::SampleCountFlagBits::e1);
-
-                vk::GraphicsPipelineCreateInfo pipeline_info({}, shaders, &vertex_input,
-                    &input_assembly, &tesselation, &viewport, &rasterization, &multisample, &depthStencil, &colorBlend, &dynamic, shadePipelineLayout.get(), shadeRenderPass.get(), 0);
-                shadePipeline = device.createGraphicsPipelineUnique({}, pipeline_info).value;
-                debugName(device, shadePipeline.get(), "Render Test Shading Pipeline");
+                shadeVariants[i] = {.pcfRadius = i/2, .shadows = static_cast<vk::Bool32>(i%2)};
+                shadeSpecializations[i] = vk::SpecializationInfo(shadeEntries, sizeof(ShadeVariant), &shadeVariants[i]);
+                shadeVariantStages[i] = shadeStages;
+                shadeVariantStages[i][1].setPSpecializationInfo(&shadeSpecializations[i]);
             }
-        }
-        shadowSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
-            {}, vk::Filter::eLinear, vk::Filter::eLinear,
-            vk::SamplerMipmapMode::eNearest,
-            vk::SamplerAddressMode::eClampToBorder, vk::SamplerAddressMode::eClampToBorder, vk::SamplerAddressMode::eClampToBorder,
-            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
-        textureSampler = device.createSamplerUnique(vk::SamplerCreateInfo(
-            {}, vk::Filter::eLinear, vk::Filter::eLinear,
-            vk::SamplerMipmapMode::eNearest,
-            vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat,
-            {}, false, {}, false, vk::CompareOp::eNever, 0, 0, vk::BorderColor::eFloatOpaqueWhite));
-
-        {
-            vk::DescriptorPoolSize size(vk::DescriptorType::eCombinedImageSampler, load_textures.size());
-            vk::DescriptorPoolCreateInfo pool_info({}, load_textures.size(), size);
-            textureDescriptorPool = device.createDescriptorPoolUnique(pool_info);
 
+            // one call lets the driver compile all of them in parallel
+            std::vector<vk::GraphicsPipelineCreateInfo> pipeline_infos = {
+                vk::GraphicsPipelineCreateInfo({}, mainStages, &model_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &multisample, &mainDepthStencil, &mainBlend, &dynamic, mainPipelineLayout.get(), mainRenderPass.get(), 0),
+                vk::GraphicsPipelineCreateInfo({}, hitboxStages, &empty_input,
+                    &line_assembly, &tesselation, &viewport, &hitboxRasterization, &multisample, &hitboxDepthStencil, &mainBlend, &dynamic, mainPipelineLayout.get(), mainRenderPass.get(), 0),
+                vk::GraphicsPipelineCreateInfo({}, shadowStages, &model_input,
+                    &input_assembly, &tesselation, &viewport, &shadowRasterization, &singlesample, &shadowDepthStencil, &shadowBlend, &dynamic, mainPipelineLayout.get(), shadowRenderPass.get(), 0),
+                vk::GraphicsPipelineCreateInfo({}, upscaleStages, &empty_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &singlesample, &noDepthStencil, &upscaleBlend, &dynamic, upscalePipelineLayout.get(), upscalePass.get(), 0)
+            };
+            for(const auto& stages : shadeVariantStages)
+            {
+                pipeline_infos.push_back(vk::GraphicsPipelineCreateInfo({}, stages, &empty_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &singlesample, &shadeDepthStencil, &shadeBlend, &dynamic, shadePipelineLayout.get(), shadeRenderPass.get(), 0));
+            }
+            if(depthPrepass)
+            {
+                pipeline_infos.push_back(vk::GraphicsPipelineCreateInfo({}, prepassStages, &model_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &multisample, &prepassDepthStencil, &prepassBlend, &dynamic, mainPipelineLayout.get(), mainRenderPass.get(), 0));
+            }
+            // copies the result of tiled lighting, the shading pass has no other work then,
+            // otherwise the ambient term is drawn once before the pass of every light is added
+            std::array<vk::PipelineShaderStageCreateInfo, 2> composeStages;
+            if(tiledLighting)
+            {
+                composeStages = stages("test/shade.vert", "test/compose.frag");
+                pipeline_infos.push_back(vk::GraphicsPipelineCreateInfo({}, composeStages, &empty_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &singlesample, &noDepthStencil, &shadeBlend, &dynamic, lightingPipelineLayout.get(), shadeRenderPass.get(), 0));
+            }
+            else
+            {
+                composeStages = stages("test/shade.vert", "test/ambient.frag");
+                pipeline_infos.push_back(vk::GraphicsPipelineCreateInfo({}, composeStages, &empty_input,
+                    &input_assembly, &tesselation, &viewport, &mainRasterization, &singlesample, &shadeDepthStencil, &shadeBlend, &dynamic, shadePipelineLayout.get(), shadeRenderPass.get(), 0));
+            }
+            auto pipelines = createPipelines(pipeline_infos);
+            mainPipeline = std::move(pipelines[0]);
+            hitboxPipeline = std::move(pipelines[1]);
+            shadowPipeline = std::move(pipelines[2]);
+            upscalePipeline = std::move(pipelines[3]);
+            for(int i=0; i<shadeVariants.size(); i++)
+            {
+                const auto& variant = shadeVariants[i];
+                shadePipelines[variant.pcfRadius][variant.shadows] = std::move(pipelines[4+i]);
+                debugName(device, shadePipelines[variant.pcfRadius][variant.shadows].get(),
+                    "Render Test Shading Pipeline (PCF "+std::to_string(variant.pcfRadius)+(variant.shadows ? "" : ", no shadows")+")");
+            }
 
-            std::vector<vk::DescriptorSetLayout> layouts(load_textures.size());
-            std::fill(layouts.begin(), layouts.end(), textureDescriptorLayout.get());
-
-            vk::DescriptorSetAllocateInfo set_info(textureDescriptorPool.get(), layouts);
-            textureDescriptorSets = device.allocateDescriptorSets(set_info);
-        }
-
-        std::vector<vk::WriteDescriptorSet> writes(load_textures.size());
-        std::vector<vk::DescriptorImageInfo> imageInfos(load_textures.size());
-        textures.resize(load_textures.size());
-        for(int i=0; i<load_textures.size(); i++)
-        {
-            auto& h = load_textures[i];
-            textures[i]= std::make_unique<texture>(device, allocator, resource_loader::getImageSize(h.data()));
-            textureSets[h] = textureDescriptorSets[i];
+            debugName(device, mainPipeline.get(), "Render Test Main Pipeline");
+            debugName(device, hitboxPipeline.get(), "Render Test Hitbox Pipeline");
+            debugName(device, shadowPipeline.get(), "Render Test Shadow Pipeline");
+            debugName(device, upscalePipeline.get(), "Render Test Upscale Pipeline");
 
-            loadingFutures.push_back(loader->loadTexture(textures[i].get(), h.data()));
+            size_t next = 4+shadeVariants.size();
+            if(depthPrepass)
+            {
+                prepassPipeline = std::move(pipelines[next++]);
+                debugName(device, prepassPipeline.get(), "Render Test Depth Pre-Pass Pipeline");
+            }
+            if(!tiledLighting)
+            {
+                ambientPipeline = std::move(pipelines[next++]);
+                debugName(device, ambientPipeline.get(), "Render Test Ambient Pipeline");
+            }
+            if(tiledLighting)
+            {
+                composePipeline = std::move(pipelines[next++]);
+                debugName(device, composePipeline.get(), "Render Test Compose Pipeline");
 
-            imageInfos[i] = vk::DescriptorImageInfo(textureSampler.get(), textures[i]->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-            writes[i] = vk::WriteDescriptorSet(textureDescriptorSets[i], 0, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos[i]);
-        }
-        device.updateDescriptorSets(writes, {});
+                vk::SpecializationMapEntry entry(0, 0, sizeof(int32_t));
+                for(int32_t radius=0; radius<=maxFilterRadius; radius++)
+                {
+                    vk::SpecializationInfo specialization(1, &entry, sizeof(int32_t), &radius);
+                    lightingPipelines[radius] = createPipeline(vk::ComputePipelineCreateInfo({},
+                        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, shaders.at("test/light.comp").get(), "main", &specialization),
+                        lightingPipelineLayout.get()));
+                    debugName(device, lightingPipelines[radius].get(), "Render Test Lighting Pipeline (PCF "+std::to_string(radius)+")");
+                }
+            }
 
-        for(int i=0; i<load_models.size(); i++)
-        {
-            auto& h = load_models[i];
-            models[h] = std::make_unique<model>(device, allocator);
-            loadingFutures.push_back(loader->loadModel(models[h].get(), h.data()));
+            if(gpuCulling)
+            {
+                cullPipeline = createPipeline(vk::ComputePipelineCreateInfo({},
+                    vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, shaders.at("test/cull.comp").get(), "main"),
+                    cullPipelineLayout.get()));
+                debugName(device, cullPipeline.get(), "Render Test Culling Pipeline");
+            }
         }
 
-        FT_Library ft;
-        FT_Error err = FT_Init_FreeType(&ft);
-        font = std::make_unique<font_renderer>("/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf", 128, device, allocator);
-        font->preload(ft, loader, overlayPass.get());
-        loadingFutures.push_back(font->textureReady);
+        fontReady.get();
+        pipelineTime += font->pipelineTime;
     }
 
     void render_test::prepare(std::vector<vk::Image> swapchainImages, std::vector<vk::ImageView> swapchainViews)
     {
+        // only the framebuffers that write into a swapchain image exist per image, everything else per frame in flight
         int imageCount = swapchainImages.size();
-        std::array<vk::DescriptorPoolSize, 8> sizes = {
-            vk::DescriptorPoolSize(vk::DescriptorType::eInputAttachment, 2*imageCount),
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
+        int frameCount = win->framesInFlight;
+        std::array<vk::DescriptorPoolSize, 14> sizes = {
+            vk::DescriptorPoolSize(vk::DescriptorType::eInputAttachment, 3*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*frameCount),
+
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*frameCount),
+
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1*frameCount),
 
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*imageCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1*frameCount),
 
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
-            vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1*imageCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 6*frameCount),
 
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, maxLights*imageCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, 1*frameCount),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1*frameCount),
+
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1*frameCount),
         };
-        vk::DescriptorPoolCreateInfo pool_info({}, (3+maxLights)*imageCount, sizes);
+        vk::DescriptorPoolCreateInfo pool_info({}, 7*frameCount, sizes);
         descriptorPool = device.createDescriptorPoolUnique(pool_info);
 
-        std::vector<vk::DescriptorSetLayout> layouts(imageCount);
+        std::vector<vk::DescriptorSetLayout> layouts(frameCount);
         vk::DescriptorSetAllocateInfo set_info(descriptorPool.get(), layouts);
 
         std::fill(layouts.begin(), layouts.end(), shadeDescriptorLayout.get());
@@ -421,39 +733,59 @@ namespace render::phases
         mainDescriptorSets = device.allocateDescriptorSets(set_info);
         shadowDescriptorSets = device.allocateDescriptorSets(set_info);
 
-        for(int i=0; i<swapchainViews.size(); i++)
+        std::fill(layouts.begin(), layouts.end(), shadowMapDescriptorLayout.get());
+        shadowMapDescriptorSets = device.allocateDescriptorSets(set_info);
+
+        std::fill(layouts.begin(), layouts.end(), upscaleDescriptorLayout.get());
+        upscaleDescriptorSets = device.allocateDescriptorSets(set_info);
+
+        if(gpuCulling)
         {
-            std::vector<vk::DescriptorSetLayout> layouts(maxLights);
-            std::fill(layouts.begin(), layouts.end(), shadowMapDescriptorLayout.get());
-            vk::DescriptorSetAllocateInfo set_info(descriptorPool.get(), layouts);
-            auto a = device.allocateDescriptorSets(set_info);
-            shadowMapDescriptorSets.push_back(a);
+            std::fill(layouts.begin(), layouts.end(), cullDescriptorLayout.get());
+            cullDescriptorSets = device.allocateDescriptorSets(set_info);
+        }
+        if(tiledLighting)
+        {
+            std::fill(layouts.begin(), layouts.end(), lightingDescriptorLayout.get());
+            lightingDescriptorSets = device.allocateDescriptorSets(set_info);
         }
 
         commandBuffers = device.allocateCommandBuffersUnique(
-            vk::CommandBufferAllocateInfo(pool.get(), vk::CommandBufferLevel::ePrimary, swapchainImages.size()));
-        this->swapchainImages = swapchainImages;
+            vk::CommandBufferAllocateInfo(pool.get(), vk::CommandBufferLevel::ePrimary, frameCount));
+
+        profiler = std::make_unique<gpu_profiler>(win->physicalDevice, device, win->deviceFeatures, graphicsFamily, frameCount, CONFIG.gpuStatistics);
+        if(!profiler->enabled() && CONFIG.dynamicResolution)
+            spdlog::warn("[Render Test] Without GPU times the resolution stays fixed");
+
+        // the new shadow maps have no content yet, so every layer is drawn the first time it is used
+        shadowCache.assign(frameCount, {});
+        shadowMapsReady.assign(frameCount, false);
+
+        int threads = CONFIG.recordingThreads > 0 ? CONFIG.recordingThreads : std::max(2u, std::thread::hardware_concurrency())-1;
+        recorder = std::make_unique<command_recorder>(device, graphicsFamily, frameCount, threads);
 
         std::vector<vk::WriteDescriptorSet> writes;
         std::vector<vk::DescriptorImageInfo> imageInfos; imageInfos.reserve(1024);
         std::vector<vk::DescriptorBufferInfo> bufferInfos; bufferInfos.reserve(1024);
 
-        shadowBuffers.resize(swapchainViews.size());
-        shadowFramebuffers.resize(swapchainViews.size());
-
-        for(int i=0; i<swapchainViews.size(); i++)
+        // tiled lighting samples the resolved G-buffer, which cannot be transient then
+        vk::ImageUsageFlags revolveUsage = vk::ImageUsageFlagBits::eInputAttachment |
+            (tiledLighting ? vk::ImageUsageFlagBits::eSampled : vk::ImageUsageFlagBits::eTransientAttachment);
+        for(int i=0; i<frameCount; i++)
         {
             colorBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
                 vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::Format::eR8G8B8A8Srgb, CONFIG.sampleCount));
             shadeBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
-                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::Format::eR32G32B32A32Sfloat, CONFIG.sampleCount));
+                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, normalFormat, CONFIG.sampleCount));
             depthBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
                 vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::Format::eD32Sfloat, CONFIG.sampleCount, false, vk::ImageAspectFlagBits::eDepth));
 
             colorRevolveBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
-                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::Format::eR8G8B8A8Srgb, vk::SampleCountFlagBits::e1, false));
+                vk::ImageUsageFlagBits::eColorAttachment | revolveUsage, vk::Format::eR8G8B8A8Srgb, vk::SampleCountFlagBits::e1, false));
             shadeRevolveBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
-                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::Format::eR32G32B32A32Sfloat, vk::SampleCountFlagBits::e1, false));
+                vk::ImageUsageFlagBits::eColorAttachment | revolveUsage, normalFormat, vk::SampleCountFlagBits::e1, false));
+            depthRevolveBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
+                vk::ImageUsageFlagBits::eDepthStencilAttachment | revolveUsage, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1, false, vk::ImageAspectFlagBits::eDepth));
 
             {
                 colorBuffers.back()->name("Render Test Color #"+std::to_string(i));
@@ -461,23 +793,32 @@ namespace render::phases
                 depthBuffers.back()->name("Render Test Depth #"+std::to_string(i));
                 colorRevolveBuffers.back()->name("Render Test Color Revolve #"+std::to_string(i));
                 shadeRevolveBuffers.back()->name("Render Test Shade Revolve #"+std::to_string(i));
+                depthRevolveBuffers.back()->name("Render Test Depth Revolve #"+std::to_string(i));
             }
-
-            for(int j=0; j<maxLights; j++)
+            sceneBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
+                vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, sceneFormat, vk::SampleCountFlagBits::e1, false));
+            sceneBuffers.back()->name("Render Test Scene #"+std::to_string(i));
+            if(tiledLighting)
             {
-                shadowBuffers[i].push_back(std::make_unique<texture>(device, allocator, CONFIG.shadowResolution, CONFIG.shadowResolution,
-                    vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1, false, vk::ImageAspectFlagBits::eDepth));
-                shadowBuffers[i].back()->name("Render Test Light Depth #"+std::to_string(i)+":"+std::to_string(j));
+                litBuffers.push_back(std::make_unique<texture>(device, allocator, win->swapchainExtent.width, win->swapchainExtent.height,
+                    vk::ImageUsageFlagBits::eStorage, vk::Format::eR16G16B16A16Sfloat, vk::SampleCountFlagBits::e1, false));
+                litBuffers.back()->name("Render Test Lit #"+std::to_string(i));
             }
 
+            shadowBuffers.push_back(std::make_unique<texture>(device, allocator, CONFIG.shadowResolution, CONFIG.shadowResolution,
+                vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled, vk::Format::eD32Sfloat, vk::SampleCountFlagBits::e1, false, vk::ImageAspectFlagBits::eDepth,
+                maxShadowLayers));
+            shadowBuffers.back()->name("Render Test Light Depth #"+std::to_string(i));
+
             {
-                std::array<vk::ImageView, 5> imageViews = {
+                std::array<vk::ImageView, 6> imageViews = {
                     colorBuffers.back()->imageView.get(),
                     shadeBuffers.back()->imageView.get(),
                     depthBuffers.back()->imageView.get(),
 
                     colorRevolveBuffers.back()->imageView.get(),
-                    shadeRevolveBuffers.back()->imageView.get()
+                    shadeRevolveBuffers.back()->imageView.get(),
+                    depthRevolveBuffers.back()->imageView.get()
                 };
                 vk::FramebufferCreateInfo framebuffer_info({}, mainRenderPass.get(), imageViews,
                     win->swapchainExtent.width, win->swapchainExtent.height, 1);
@@ -485,10 +826,11 @@ namespace render::phases
                 debugName(device, mainFramebuffers.back().get(), "Render Test Main Framebuffer #"+std::to_string(i));
             }
             {
-                std::array<vk::ImageView, 3> imageViews = {
+                std::array<vk::ImageView, 4> imageViews = {
                     colorRevolveBuffers.back()->imageView.get(),
                     shadeRevolveBuffers.back()->imageView.get(),
-                    swapchainViews[i]
+                    depthRevolveBuffers.back()->imageView.get(),
+                    sceneBuffers.back()->imageView.get()
                 };
                 vk::FramebufferCreateInfo framebuffer_info({}, shadeRenderPass.get(), imageViews,
                     win->swapchainExtent.width, win->swapchainExtent.height, 1);
@@ -496,32 +838,33 @@ namespace render::phases
                 debugName(device, shadeFramebuffers.back().get(), "Render Test Shade Framebuffer #"+std::to_string(i));
             }
             {
-                for(int j=0; j<maxLights; j++)
-                {
-                    vk::FramebufferCreateInfo framebuffer_info({}, shadowRenderPass.get(), shadowBuffers[i][j]->imageView.get(),
-                        CONFIG.shadowResolution, CONFIG.shadowResolution, 1);
-                    shadowFramebuffers[i].push_back(device.createFramebufferUnique(framebuffer_info));
-                    debugName(device, shadowFramebuffers[i].back().get(), "Render Test Shadow Framebuffer #"+std::to_string(i)+":"+std::to_string(j));
-                }
-            }
-            {
-                vk::FramebufferCreateInfo framebuffer_info({}, overlayPass.get(), swapchainViews[i],
-                    win->swapchainExtent.width, win->swapchainExtent.height, 1);
-                overlayFramebuffers.push_back(device.createFramebufferUnique(framebuffer_info));
-                debugName(device, overlayFramebuffers.back().get(), "Render Test Overlay Framebuffer #"+std::to_string(i));
+                vk::FramebufferCreateInfo framebuffer_info({}, shadowRenderPass.get(), shadowBuffers.back()->imageView.get(),
+                    CONFIG.shadowResolution, CONFIG.shadowResolution, maxShadowLayers);
+                shadowFramebuffers.push_back(device.createFramebufferUnique(framebuffer_info));
+                debugName(device, shadowFramebuffers.back().get(), "Render Test Shadow Framebuffer #"+std::to_string(i));
             }
 
             debugName(device, commandBuffers[i].get(), "Render Test Command Buffer #"+std::to_string(i));
 
             {
-                vk::BufferCreateInfo buffer_info({}, maxLights*sizeof(LightInfo), vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
+                vk::BufferCreateInfo buffer_info({}, maxLights*lightInfoStride, vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
                 vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
                 auto [lb, la] = allocator.createBuffer(buffer_info, alloc_info);
                 lightUniformBuffers.push_back(lb);
                 lightUniformAllocations.push_back(la);
-                lightUniformPointers.push_back((LightInfo*)allocator.mapMemory(la));
+                lightUniformPointers.push_back((uint8_t*)allocator.mapMemory(la));
                 debugName(device, lightUniformBuffers[i], "Render Test Light Uniform Buffer #"+std::to_string(i));
             }
+            if(tiledLighting)
+            {
+                vk::BufferCreateInfo buffer_info({}, maxTiledLights*sizeof(LightInfo), vk::BufferUsageFlagBits::eStorageBuffer, vk::SharingMode::eExclusive);
+                vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
+                auto [lb, la] = allocator.createBuffer(buffer_info, alloc_info);
+                lightStorageBuffers.push_back(lb);
+                lightStorageAllocations.push_back(la);
+                lightStoragePointers.push_back((LightInfo*)allocator.mapMemory(la));
+                debugName(device, lightStorageBuffers[i], "Render Test Light Storage Buffer #"+std::to_string(i));
+            }
             {
                 vk::BufferCreateInfo buffer_info({}, sizeof(GlobalInfo), vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
                 vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
@@ -532,7 +875,7 @@ namespace render::phases
                 debugName(device, globalUniformBuffers[i], "Render Test Global Uniform Buffer #"+std::to_string(i));
             }
             {
-                vk::BufferCreateInfo buffer_info({}, maxLights*sizeof(GlobalInfo), vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
+                vk::BufferCreateInfo buffer_info({}, maxShadowLayers*sizeof(GlobalInfo), vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
                 vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
                 auto [gb, ga] = allocator.createBuffer(buffer_info, alloc_info);
                 globalShadowUniformBuffers.push_back(gb);
@@ -540,47 +883,85 @@ namespace render::phases
                 globalShadowUniformPointers.push_back((GlobalInfo*)allocator.mapMemory(ga));
                 debugName(device, globalShadowUniformBuffers[i], "Render Test Global Shadow Uniform Buffer #"+std::to_string(i));
             }
+            if(gpuCulling)
             {
-                vk::BufferCreateInfo buffer_info({}, maxObjects*sizeof(ModelInfo), vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
-                vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
-                auto [mb, ma] = allocator.createBuffer(buffer_info, alloc_info);
-                modelUniformBuffers.push_back(mb);
-                modelUniformAllocations.push_back(ma);
-                modelUniformPointers.push_back((ModelInfo*)allocator.mapMemory(ma));
-                debugName(device, modelUniformBuffers[i], "Render Test Model Uniform Buffer #"+std::to_string(i));
+                {
+                    vk::BufferCreateInfo buffer_info({}, viewCount*sizeof(CullView), vk::BufferUsageFlagBits::eStorageBuffer, vk::SharingMode::eExclusive);
+                    vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
+                    auto [vb, va] = allocator.createBuffer(buffer_info, alloc_info);
+                    cullViewBuffers.push_back(vb);
+                    cullViewAllocations.push_back(va);
+                    cullViewPointers.push_back((CullView*)allocator.mapMemory(va));
+                    debugName(device, cullViewBuffers[i], "Render Test Cull View Buffer #"+std::to_string(i));
+                }
+
+                // the other bindings are written by allocate_object_buffers()
+                bufferInfos.push_back(vk::DescriptorBufferInfo(cullViewBuffers[i], 0, VK_WHOLE_SIZE));
+                writes.push_back(vk::WriteDescriptorSet(cullDescriptorSets[i], 5, 0, vk::DescriptorType::eStorageBuffer, {}, bufferInfos.back()));
             }
 
             imageInfos.push_back(vk::DescriptorImageInfo({}, colorRevolveBuffers.back()->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
             imageInfos.push_back(vk::DescriptorImageInfo({}, shadeRevolveBuffers.back()->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
 
-            writes.push_back(vk::WriteDescriptorSet(shadeDescriptorSets[i], 0, 0, 2, vk::DescriptorType::eInputAttachment, imageInfos.data()+(2+maxLights)*i));
+            writes.push_back(vk::WriteDescriptorSet(shadeDescriptorSets[i], 0, 0, 2, vk::DescriptorType::eInputAttachment, &imageInfos[imageInfos.size()-2]));
 
             bufferInfos.push_back(vk::DescriptorBufferInfo(lightUniformBuffers[i], 0, sizeof(LightInfo)));
             writes.push_back(vk::WriteDescriptorSet(shadeDescriptorSets[i], 2, 0, vk::DescriptorType::eUniformBufferDynamic, {},  bufferInfos.back()));
+            imageInfos.push_back(vk::DescriptorImageInfo({}, depthRevolveBuffers.back()->imageView.get(), vk::ImageLayout::eDepthStencilReadOnlyOptimal));
+            writes.push_back(vk::WriteDescriptorSet(shadeDescriptorSets[i], 3, 0, vk::DescriptorType::eInputAttachment, imageInfos.back()));
 
-            for(int j=0; j<maxLights; j++)
+            if(tiledLighting)
             {
-                imageInfos.push_back(vk::DescriptorImageInfo(shadowSampler.get(), shadowBuffers[i][j]->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
-                writes.push_back(vk::WriteDescriptorSet(shadowMapDescriptorSets[i][j], 0, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos.back()));
+                std::array<texture*, 3> gbuffer = {colorRevolveBuffers.back().get(), shadeRevolveBuffers.back().get(), depthRevolveBuffers.back().get()};
+                for(uint32_t b=0; b<gbuffer.size(); b++)
+                {
+                    imageInfos.push_back(vk::DescriptorImageInfo(gbufferSampler.get(), gbuffer[b]->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
+                    writes.push_back(vk::WriteDescriptorSet(lightingDescriptorSets[i], b, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos.back()));
+                }
+                imageInfos.push_back(vk::DescriptorImageInfo({}, litBuffers.back()->imageView.get(), vk::ImageLayout::eGeneral));
+                writes.push_back(vk::WriteDescriptorSet(lightingDescriptorSets[i], 3, 0, vk::DescriptorType::eStorageImage, imageInfos.back()));
+                bufferInfos.push_back(vk::DescriptorBufferInfo(lightStorageBuffers[i], 0, VK_WHOLE_SIZE));
+                writes.push_back(vk::WriteDescriptorSet(lightingDescriptorSets[i], 4, 0, vk::DescriptorType::eStorageBuffer, {}, bufferInfos.back()));
             }
 
+            imageInfos.push_back(vk::DescriptorImageInfo(upscaleSampler.get(), sceneBuffers.back()->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
+            writes.push_back(vk::WriteDescriptorSet(upscaleDescriptorSets[i], 0, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos.back()));
+
+            imageInfos.push_back(vk::DescriptorImageInfo(shadowSampler.get(), shadowBuffers[i]->imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal));
+            writes.push_back(vk::WriteDescriptorSet(shadowMapDescriptorSets[i], 0, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos.back()));
+            bufferInfos.push_back(vk::DescriptorBufferInfo(globalShadowUniformBuffers[i], 0, maxShadowLayers*sizeof(GlobalInfo)));
+            writes.push_back(vk::WriteDescriptorSet(shadowMapDescriptorSets[i], 1, 0, vk::DescriptorType::eUniformBuffer, {}, bufferInfos.back()));
+
             bufferInfos.push_back(vk::DescriptorBufferInfo(globalUniformBuffers[i], 0, sizeof(GlobalInfo)));
             writes.push_back(vk::WriteDescriptorSet(mainDescriptorSets[i], 0, 0, vk::DescriptorType::eUniformBufferDynamic, {},  bufferInfos.back()));
 
-            bufferInfos.push_back(vk::DescriptorBufferInfo(modelUniformBuffers[i], 0, sizeof(ModelInfo)));
-            writes.push_back(vk::WriteDescriptorSet(mainDescriptorSets[i], 1, 0, vk::DescriptorType::eUniformBufferDynamic, {},  bufferInfos.back()));
-
 
-            bufferInfos.push_back(vk::DescriptorBufferInfo(globalShadowUniformBuffers[i], 0, sizeof(GlobalInfo)));
+            bufferInfos.push_back(vk::DescriptorBufferInfo(globalShadowUniformBuffers[i], 0, maxShadowLayers*sizeof(GlobalInfo)));
             writes.push_back(vk::WriteDescriptorSet(shadowDescriptorSets[i], 0, 0, vk::DescriptorType::eUniformBufferDynamic, {},  bufferInfos.back()));
-
-            bufferInfos.push_back(vk::DescriptorBufferInfo(modelUniformBuffers[i], 0, sizeof(ModelInfo)));
-            writes.push_back(vk::WriteDescriptorSet(shadowDescriptorSets[i], 1, 0, vk::DescriptorType::eUniformBufferDynamic, {},  bufferInfos.back()));
         }
 
         device.updateDescriptorSets(writes, {});
 
-        font->prepare(imageCount);
+        // grown by extract() when a frame has more objects
+        objectCapacity.assign(frameCount, 0);
+        for(int i=0; i<frameCount; i++)
+        {
+            allocate_object_buffers(i, initialObjects);
+        }
+
+        for(int i=0; i<imageCount; i++)
+        {
+            vk::FramebufferCreateInfo framebuffer_info({}, overlayPass.get(), swapchainViews[i],
+                win->swapchainExtent.width, win->swapchainExtent.height, 1);
+            overlayFramebuffers.push_back(device.createFramebufferUnique(framebuffer_info));
+            debugName(device, overlayFramebuffers.back().get(), "Render Test Overlay Framebuffer #"+std::to_string(i));
+
+            framebuffer_info.setRenderPass(upscalePass.get());
+            upscaleFramebuffers.push_back(device.createFramebufferUnique(framebuffer_info));
+            debugName(device, upscaleFramebuffers.back().get(), "Render Test Upscale Framebuffer #"+std::to_string(i));
+        }
+
+        font->prepare(frameCount);
     }
 
     void render_test::init()
@@ -593,102 +974,325 @@ namespace render::phases
         camera = entity;
     }
 
-    void render_test::render(int frame, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
+    uint32_t render_test::allocate_texture_slot(const texture& tex)
     {
-        vk::UniqueCommandBuffer& commandBuffer = commandBuffers[frame];
-        commandBuffer->begin(vk::CommandBufferBeginInfo());
-        vk::DebugUtilsLabelEXT label{};
-
-        std::map<entity::entity_id, int> entityDescriptors;
+        if(textureSlotCount == textureSlotLimit)
         {
-            int j=0;
-            for(auto [e2, p2, m2] : modelView.each())
-            {
-                modelUniformPointers[frame][j].transform = glm::mat4(1.0)
-                    * glm::translate(glm::mat4(1.0), (glm::vec3)p2);
-                entityDescriptors[e2] = j;
+            spdlog::warn("[Render Test] All {} texture slots are in use, using the placeholder instead", textureSlotLimit);
+            return placeholderTexture.slot;
+        }
+        uint32_t slot = textureSlotCount++;
 
-                const entity::components::rotation* rotation;
-                if((rotation=entities.try_get<const entity::components::rotation>(e2)) != nullptr)
-                {
-                    modelUniformPointers[frame][j].transform *= glm::rotate(glm::mat4(1.0), (float)rotation->yaw, glm::vec3(0.0, 1.0, 0.0));
-                    //spdlog::debug("Rotation {}", rotation->yaw);
-                }
+        // shaders only index slots of textures that have finished loading, the write itself can happen any time
+        vk::DescriptorImageInfo image_info(textureSampler.get(), tex.imageView.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+        device.updateDescriptorSets(vk::WriteDescriptorSet(textureDescriptorSet, 0, slot, vk::DescriptorType::eCombinedImageSampler, image_info), {});
+        return slot;
+    }
 
-                j++;
-                if(j > maxObjects)
-                    break;
-            }
-        }
+    void render_test::request_assets(entt::registry& registry, entity::entity_id e)
+    {
+        const auto& m = registry.get<entity::components::model>(e);
+        request_model(m.model_name);
+        request_texture(m.texture_name);
+    }
+
+    const std::string* render_test::asset_file(entt::hashed_string::hash_type name)
+    {
+        const auto* names = entities.ctx().find<entity::asset_names>();
+        const std::string* file = names ? names->find(name) : nullptr;
+        if(!file)
+            spdlog::warn("[Render Test] No file registered for asset {:#x}, it will not be drawn", name);
+        return file;
+    }
+
+    void render_test::request_model(entt::hashed_string::hash_type name)
+    {
+        if(models.contains(name))
+            return;
+        auto& asset = models[name];
+
+        const std::string* file = asset_file(name);
+        if(!file)
+            return;
+        asset.mesh = std::make_unique<model>(device, allocator);
+        asset.future = loader->loadModel(asset.mesh.get(), *file);
+    }
 
+    void render_test::request_texture(entt::hashed_string::hash_type name)
+    {
+        if(textures.contains(name))
+            return;
+        auto& asset = textures[name];
+
+        const std::string* file = asset_file(name);
+        if(!file)
+            return;
+        asset.tex = std::make_unique<texture>(device, allocator, resource_loader::getImageSize(*file));
+        asset.tex->name("Render Test Texture "+*file);
+        asset.slot = allocate_texture_slot(*asset.tex);
+        asset.future = loader->loadTexture(asset.tex.get(), *file);
+    }
+
+    void render_test::update_assets()
+    {
+        // the loader already logged why an asset failed, it is dropped so that the placeholder or nothing is drawn instead
+        auto finished = [](std::shared_future<void>& future){
+            if(!future.valid() || !utils::is_ready(future))
+                return false;
+            if(utils::has_succeeded(future))
+                return true;
+            future = {};
+            return false;
+        };
+        if(!placeholderTexture.ready && finished(placeholderTexture.future))
+            placeholderTexture.ready = true;
+        for(auto& [name, asset] : textures)
         {
-            vk::Viewport viewport(0.0f, 0.0f, (float)CONFIG.shadowResolution, (float)CONFIG.shadowResolution, 0.0f, 1.0f);
-            vk::Rect2D scissor({0,0}, {CONFIG.shadowResolution, CONFIG.shadowResolution});
-            commandBuffer->setViewport(0, viewport);
-            commandBuffer->setScissor(0, scissor);
+            if(!asset.ready && finished(asset.future))
+                asset.ready = true;
         }
-        commandBuffer->beginDebugUtilsLabelEXT(label.setPLabelName("Shadow Render"));
-        int l=0;
-        std::map<entity::entity_id, int> lightDescriptors;
-        for(auto [entity, position, light] : lightView.each())
+        for(auto& [name, asset] : models)
+        {
+            if(!asset.ready && finished(asset.future))
+                asset.ready = true;
+        }
+    }
+
+    model* render_test::find_model(entt::hashed_string::hash_type name)
+    {
+        auto it = models.find(name);
+        if(it == models.end() || !it->second.ready)
+            return nullptr;
+        return it->second.mesh.get();
+    }
+
+    std::optional<uint32_t> render_test::find_texture(entt::hashed_string::hash_type name)
+    {
+        auto it = textures.find(name);
+        if(it != textures.end() && it->second.ready)
+            return it->second.slot;
+        if(placeholderTexture.ready)
+            return placeholderTexture.slot;
+        return std::nullopt;
+    }
+
+    void render_test::render_list::clear()
+    {
+        entities.clear();
+        transforms.clear();
+        meshes.clear();
+        textures.clear();
+        flags.clear();
+        bounds.clear();
+        casters = 0;
+        casterMin = glm::vec3(std::numeric_limits<float>::max());
+        casterMax = glm::vec3(std::numeric_limits<float>::lowest());
+        order.clear();
+        slots.clear();
+        mainBatches.clear();
+        shadowBatches.clear();
+    }
+
+    void render_test::allocate_object_buffers(int frame, uint32_t capacity)
+    {
+        objectCapacity[frame] = capacity;
+        std::string suffix = " #"+std::to_string(frame);
+        auto create = [this, frame](vk::DeviceSize size, vk::BufferUsageFlags usage, std::vector<vk::Buffer>& buffers,
+            std::vector<vma::Allocation>& allocations, const std::string& name) -> void*
         {
-            lightDescriptors[entity] = l;
+            vk::BufferCreateInfo buffer_info({}, size, usage, vk::SharingMode::eExclusive);
+            vma::AllocationCreateInfo alloc_info({}, vma::MemoryUsage::eCpuToGpu);
+            auto [b, a] = allocator.createBuffer(buffer_info, alloc_info);
+            buffers.resize(objectCapacity.size());
+            allocations.resize(objectCapacity.size());
+            buffers[frame] = b;
+            allocations[frame] = a;
+            debugName(device, b, name);
+            return allocator.mapMemory(a);
+        };
 
-            vk::ClearValue depthClear = vk::ClearDepthStencilValue(1.0f, 0);
-            commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(shadowRenderPass.get(), shadowFramebuffers[frame][l].get(),
-                vk::Rect2D({0, 0}, {CONFIG.shadowResolution, CONFIG.shadowResolution}), depthClear), vk::SubpassContents::eInline);
+        modelPointers.resize(objectCapacity.size());
+        modelPointers[frame] = (ModelInfo*)create(capacity*sizeof(ModelInfo), vk::BufferUsageFlagBits::eStorageBuffer,
+            modelBuffers, modelAllocations, "Render Test Model Buffer"+suffix);
+        // the shadow pass needs room for every caster in every layer
+        instancePointers.resize(objectCapacity.size());
+        instancePointers[frame] = (uint32_t*)create(viewCount*capacity*sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+            instanceBuffers, instanceAllocations, "Render Test Instance Buffer"+suffix);
 
-            //globalShadowUniformPointers[frame]->projection = glm::perspective(light.fov, 1.0f, light.zNear, light.zFar);
-            globalShadowUniformPointers[frame][l].projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, light.zNear, light.zFar);
-            globalShadowUniformPointers[frame][l].view = glm::lookAt((glm::vec3)position, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
-            commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.get());
+        std::vector<vk::DescriptorBufferInfo> bufferInfos; bufferInfos.reserve(8);
+        std::vector<vk::WriteDescriptorSet> writes;
+        bufferInfos.push_back(vk::DescriptorBufferInfo(modelBuffers[frame], 0, VK_WHOLE_SIZE));
+        writes.push_back(vk::WriteDescriptorSet(mainDescriptorSets[frame], 1, 0, vk::DescriptorType::eStorageBuffer, {}, bufferInfos.back()));
+        writes.push_back(vk::WriteDescriptorSet(shadowDescriptorSets[frame], 1, 0, vk::DescriptorType::eStorageBuffer, {}, bufferInfos.back()));
 
-            int j=0;
-            for(auto [e2, p2, m2] : modelView.each())
+        if(gpuCulling)
+        {
+            objectPointers.resize(objectCapacity.size());
+            objectPointers[frame] = (glm::uvec2*)create(capacity*sizeof(glm::uvec2), vk::BufferUsageFlagBits::eStorageBuffer,
+                objectBuffers, objectAllocations, "Render Test Object Buffer"+suffix);
+            drawCommandPointers.resize(objectCapacity.size());
+            drawCommandPointers[frame] = (vk::DrawIndexedIndirectCommand*)create(passCount*capacity*sizeof(vk::DrawIndexedIndirectCommand),
+                vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                drawCommandBuffers, drawCommandAllocations, "Render Test Draw Command Buffer"+suffix);
+            drawCountPointers.resize(objectCapacity.size());
+            drawCountPointers[frame] = (uint32_t*)create((statistics_offset(frame)+viewCount)*sizeof(uint32_t),
+                vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                drawCountBuffers, drawCountAllocations, "Render Test Draw Count Buffer"+suffix);
+            std::fill_n(drawCountPointers[frame]+statistics_offset(frame), viewCount, 0);
+
+            // binding 5 holds the views, which do not depend on the number of objects
+            std::array<vk::Buffer, 5> buffers = {modelBuffers[frame], objectBuffers[frame], drawCommandBuffers[frame], drawCountBuffers[frame], instanceBuffers[frame]};
+            for(uint32_t b=0; b<buffers.size(); b++)
             {
-                const entity::components::renderable r = entities.get<entity::components::renderable>(e2);
-                if(!r.shadowCaster)
-                    continue;
+                bufferInfos.push_back(vk::DescriptorBufferInfo(buffers[b], 0, VK_WHOLE_SIZE));
+                writes.push_back(vk::WriteDescriptorSet(cullDescriptorSets[frame], b, 0, vk::DescriptorType::eStorageBuffer, {}, bufferInfos.back()));
+            }
+        }
+        device.updateDescriptorSets(writes, {});
+    }
 
-                auto& model = models[m2.model_name];
-                commandBuffer->bindVertexBuffers(0, model->vertexBuffer, {0L});
-                commandBuffer->bindIndexBuffer(model->indexBuffer, 0, vk::IndexType::eUint32);
+    void render_test::free_object_buffers(int frame)
+    {
+        allocator.unmapMemory(modelAllocations[frame]);
+        allocator.destroyBuffer(modelBuffers[frame], modelAllocations[frame]);
+        allocator.unmapMemory(instanceAllocations[frame]);
+        allocator.destroyBuffer(instanceBuffers[frame], instanceAllocations[frame]);
+        if(gpuCulling)
+        {
+            allocator.unmapMemory(objectAllocations[frame]);
+            allocator.destroyBuffer(objectBuffers[frame], objectAllocations[frame]);
+            allocator.unmapMemory(drawCommandAllocations[frame]);
+            allocator.destroyBuffer(drawCommandBuffers[frame], drawCommandAllocations[frame]);
+            allocator.unmapMemory(drawCountAllocations[frame]);
+            allocator.destroyBuffer(drawCountBuffers[frame], drawCountAllocations[frame]);
+        }
+        objectCapacity[frame] = 0;
+    }
 
-                int q = entityDescriptors[e2];
-                commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, shadowDescriptorSets[frame],
-                    {(uint32_t)(l*sizeof(GlobalInfo)), (uint32_t)(q*sizeof(ModelInfo))});
-                commandBuffer->drawIndexed(model->indexCount, 1, 0, 0, 0);
+    void render_test::extract(int frame)
+    {
+        renderList.clear();
 
-                j++;
-                if(j > maxObjects)
-                    break;
+        auto& rotations = entities.storage<entity::components::rotation>();
+        auto& collisions = entities.storage<entity::components::collision>();
+        for(auto [e, position, m, r] : renderGroup.each())
+        {
+            model* mesh = find_model(m.model_name);
+            std::optional<uint32_t> texture = find_texture(m.texture_name);
+            if(!mesh || !texture)
+                continue;
+
+            glm::mat4 transform = glm::translate(glm::mat4(1.0), (glm::vec3)position);
+            if(rotations.contains(e))
+                transform *= glm::rotate(glm::mat4(1.0), (float)rotations.get(e).yaw, glm::vec3(0.0, 1.0, 0.0));
+
+            renderList.entities.push_back(e);
+            renderList.transforms.push_back(transform);
+            renderList.meshes.push_back(mesh);
+            renderList.textures.push_back(*texture);
+            renderList.flags.push_back((r.shadowCaster ? ShadowCaster : 0) | (r.shadowCatcher ? ShadowCatcher : 0) |
+                (collisions.contains(e) ? Hitbox : 0));
+            renderList.bounds.push_back(transform, mesh->min, mesh->max);
+            renderList.casters += r.shadowCaster;
+            if(r.shadowCaster)
+            {
+                const auto& bounds = renderList.bounds;
+                size_t k = bounds.size()-1;
+                renderList.casterMin = glm::min(renderList.casterMin, glm::vec3(bounds.minX[k], bounds.minY[k], bounds.minZ[k]));
+                renderList.casterMax = glm::max(renderList.casterMax, glm::vec3(bounds.maxX[k], bounds.maxY[k], bounds.maxZ[k]));
             }
-            commandBuffer->endRenderPass();
 
-            l++;
-            if(l>maxLights)
-                return;
+            if(renderList.size() == maxObjects)
+                break;
         }
-        commandBuffer->endDebugUtilsLabelEXT();
 
-         std::array<vk::ClearValue, 4> mainClear = {
-            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
-            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
-            vk::ClearDepthStencilValue(1.0f, 0),
-            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f})
-        };
+        // the fence of this frame has been waited for, so its buffers and descriptor sets are not in use anymore
+        if(renderList.size() > objectCapacity[frame])
+        {
+            uint32_t capacity = std::min<size_t>(std::max<size_t>(renderList.size(), 2*objectCapacity[frame]), maxObjects);
+            spdlog::debug("[Render Test] Growing the object buffers of frame {} from {} to {} objects", frame, objectCapacity[frame], capacity);
+            free_object_buffers(frame);
+            allocate_object_buffers(frame, capacity);
+        }
+
+        // entries sharing a model end up next to each other and can be drawn as one instanced draw, textures are per instance
+        renderList.order.resize(renderList.size());
+        std::iota(renderList.order.begin(), renderList.order.end(), 0);
+        std::sort(renderList.order.begin(), renderList.order.end(), [this](uint32_t a, uint32_t b){
+            return std::make_tuple(renderList.meshes[a], renderList.textures[a]) <
+                std::make_tuple(renderList.meshes[b], renderList.textures[b]);
+        });
 
+        renderList.slots.resize(renderList.size());
+        for(uint32_t slot=0; slot<renderList.order.size(); slot++)
         {
-            vk::Viewport viewport(0.0f, 0.0f, win->swapchainExtent.width, win->swapchainExtent.height, 0.0f, 1.0f);
-            vk::Rect2D scissor({0,0}, win->swapchainExtent);
-            commandBuffer->setViewport(0, viewport);
-            commandBuffer->setScissor(0, scissor);
+            uint32_t i = renderList.order[slot];
+            const auto& bounds = renderList.bounds;
+            modelPointers[frame][slot].transform = renderList.transforms[i];
+            modelPointers[frame][slot].min = glm::vec4(bounds.minX[i], bounds.minY[i], bounds.minZ[i], 0.0);
+            modelPointers[frame][slot].max = glm::vec4(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i], 0.0);
+            modelPointers[frame][slot].material = glm::uvec4(renderList.textures[i], 0, 0, 0);
+            renderList.slots[i] = slot;
+
+            if(!gpuCulling)
+                continue;
+
+            // the compute pass packs the visible instances of a batch from its first slot on, so there is always enough room,
+            // in the shadow pass every slot has room for one instance per layer
+            auto& mainBatches = renderList.mainBatches;
+            if(mainBatches.empty() || mainBatches.back().mesh != renderList.meshes[i])
+                mainBatches.push_back({renderList.meshes[i], slot, 0});
+            mainBatches.back().instanceCount++;
+
+            uint32_t shadowBatch = ~0u;
+            if(renderList.flags[i] & ShadowCaster)
+            {
+                auto& shadowBatches = renderList.shadowBatches;
+                if(shadowBatches.empty() || shadowBatches.back().mesh != renderList.meshes[i])
+                    shadowBatches.push_back({renderList.meshes[i], objectCapacity[frame] + slot*maxShadowLayers, 0});
+                shadowBatches.back().instanceCount++;
+                shadowBatch = shadowBatches.size()-1;
+            }
+            objectPointers[frame][slot] = glm::uvec2(mainBatches.size()-1, shadowBatch);
+        }
+    }
+
+    void render_test::build_batches(int frame, uint32_t pass)
+    {
+        pass_batches& out = passBatches[pass];
+        for(uint32_t v=0; v<views.size(); v++)
+        {
+            if(views[v].pass == pass)
+                culling::cull(views[v].frustum, renderList.bounds, viewVisible[v]);
         }
-        commandBuffer->beginDebugUtilsLabelEXT(label.setPLabelName("Main Render"));
-        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(mainRenderPass.get(), mainFramebuffers[frame].get(),
-            vk::Rect2D({0, 0}, win->swapchainExtent), mainClear), vk::SubpassContents::eInline);
-        commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, mainPipeline.get());
 
+        // every pass has its own part of the instance buffer, so passes can be culled in parallel
+        uint32_t instanceOffset = pass*objectCapacity[frame];
+        out.batches.clear();
+        out.drawn = 0;
+        for(uint32_t i : renderList.order)
+        {
+            if(pass == shadowPass && !(renderList.flags[i] & ShadowCaster))
+                continue;
+
+            // one instance per view that sees the entry, the layer tells the shader which view it is for
+            for(uint32_t v=0; v<views.size(); v++)
+            {
+                if(views[v].pass != pass || !viewVisible[v][i])
+                    continue;
+
+                if(out.batches.empty() || out.batches.back().mesh != renderList.meshes[i])
+                    out.batches.push_back({renderList.meshes[i], instanceOffset, 0});
+                instancePointers[frame][instanceOffset++] = renderList.slots[i] | (views[v].layer << layerShift);
+                out.batches.back().instanceCount++;
+                out.drawn++;
+            }
+        }
+    }
+
+    void render_test::update_views(int frame)
+    {
         entity::components::target_camera cam = entities.get<entity::components::target_camera>(camera);
         entity::components::position camTarget = entities.get<entity::components::position>(cam.target);
         globalUniformPointers[frame]->projection = glm::perspective(cam.fov,
@@ -701,87 +1305,612 @@ namespace render::phases
             glm::translate(glm::mat4(1.0), -(glm::vec3)camTarget - cam.offset) *
             glm::mat4(1.0);
 
-        for(auto [e2, p2, m2] : modelView.each())
+        const GlobalInfo& global = *globalUniformPointers[frame];
+        views.clear();
+        views.push_back({culling::frustum::from_matrix(global.projection * global.view), mainPass, 0});
+
+        // lights take the layers of the shadow map in order, the ones that do not fit anymore are drawn without shadows
+        uint32_t layer = 0;
+        layerLights.fill(entt::null);
+        int l=0;
+        int lightLimit = tiledLighting ? maxTiledLights : maxLights;
+        for(auto [entity, position, light] : lightView.each())
         {
-            auto& model = models[m2.model_name];
-            auto& textureSet = textureSets[m2.texture_name];
-            int q = entityDescriptors[e2];
+            if(l >= lightLimit)
+                break;
+
+            LightInfo& info = tiledLighting ? lightStoragePointers[frame][l++] : light_info(frame, l++);
+            info.direction = glm::vec4(glm::normalize(light.direction), 0.0);
+            info.color = glm::vec4(light.color, light.radius);
+            info.globalInverse = glm::inverse(global.projection * global.view);
+            // beyond any depth, so a single layer covers everything
+            info.cascadeSplits = glm::vec4(std::numeric_limits<float>::max());
+            info.position = light.directional ? info.direction : glm::vec4((glm::vec3)position, 1.0);
+
+            int layerCount = light.directional ? std::clamp(CONFIG.shadowCascades, 1, maxCascades) : 1;
+            info.shadow = glm::ivec4(layer, 0, 0, 0);
+            if(!light.castShadow || layer+layerCount > maxShadowLayers)
+                continue;
+            info.shadow.y = layerCount;
+
+            if(light.directional)
+                info.cascadeSplits = fit_cascades(frame, cam, info.direction, layer, layerCount);
+            else
+            {
+                globalShadowUniformPointers[frame][layer].projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, light.zNear, light.zFar);
+                globalShadowUniformPointers[frame][layer].view = glm::lookAt((glm::vec3)position, glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+            }
+            for(int i=0; i<layerCount; i++)
+                layerLights[layer++] = entity;
+        }
+        lightCount = l;
+        usedLayers = layer;
+    }
 
-            commandBuffer->bindVertexBuffers(0, model->vertexBuffer, {0L});
-            commandBuffer->bindIndexBuffer(model->indexBuffer, 0, vk::IndexType::eUint32);
+    void render_test::mark_changed(entt::registry&, entity::entity_id e)
+    {
+        changedEntities.insert(e);
+    }
 
-            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, mainDescriptorSets[frame],
-                {0U, (uint32_t)(q*sizeof(ModelInfo))});
-            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 1, textureSet, {});
-            commandBuffer->drawIndexed(model->indexCount, 1, 0, 0, 0);
+    void render_test::update_shadow_cache(int frame)
+    {
+        // a changed caster affects the layers that saw it before and the ones that see it now
+        dirtyBounds.clear();
+        for(entity::entity_id e : changedEntities)
+        {
+            if(auto it = casterBounds.find(e); it != casterBounds.end())
+            {
+                dirtyBounds.push_back(glm::mat4(1.0), it->second.first, it->second.second);
+                casterBounds.erase(it);
+            }
+        }
+        for(uint32_t i=0; i<renderList.size(); i++)
+        {
+            if(!(renderList.flags[i] & ShadowCaster))
+                continue;
+            auto [it, added] = casterBounds.try_emplace(renderList.entities[i]);
+            if(!added)
+                continue;
+            const auto& bounds = renderList.bounds;
+            it->second = {glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]), glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i])};
+            dirtyBounds.push_back(glm::mat4(1.0), it->second.first, it->second.second);
         }
 
-        commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, hitboxPipeline.get());
-        for(auto [e2, p2, m2, c2] : hitboxView.each())
+        std::vector<uint8_t> visible;
+        for(uint32_t layer=0; layer<usedLayers; layer++)
         {
-            int q = entityDescriptors[e2];
+            const GlobalInfo& matrices = globalShadowUniformPointers[frame][layer];
+            bool dirty = changedEntities.contains(layerLights[layer]) ||
+                (dirtyBounds.size() && culling::cull(culling::frustum::from_matrix(matrices.projection * matrices.view), dirtyBounds, visible));
+            if(!dirty)
+                continue;
+            // the copies in the shadow maps of the other frames are just as outdated
+            for(auto& cache : shadowCache)
+                cache[layer].valid = false;
+        }
+        changedEntities.clear();
 
-            auto& model = models[m2.model_name];
+        // layers of another light or without content are always drawn, stale ones as the budget allows
+        std::array<bool, maxShadowLayers> draw{};
+        uint32_t budget = CONFIG.shadowUpdateBudget > 0 ? CONFIG.shadowUpdateBudget : maxShadowLayers;
+        for(uint32_t i=0; i<usedLayers; i++)
+        {
+            uint32_t layer = (shadowRefreshCursor + i) % usedLayers;
+            const shadow_layer_cache& cache = shadowCache[frame][layer];
+            const GlobalInfo& matrices = globalShadowUniformPointers[frame][layer];
+            if(cache.light != layerLights[layer])
+                draw[layer] = true;
+            else if(!cache.valid || cache.matrices.projection != matrices.projection || cache.matrices.view != matrices.view)
+            {
+                if(budget == 0)
+                    continue;
+                draw[layer] = true;
+                budget--;
+                shadowRefreshCursor = layer+1;
+            }
+        }
 
-            glm::vec3 m = model->min;
-            glm::vec3 p = model->max;
+        cullStatistics.shadowLayers = usedLayers;
+        for(uint32_t layer=0; layer<usedLayers; layer++)
+        {
+            shadow_layer_cache& cache = shadowCache[frame][layer];
+            if(!draw[layer])
+            {
+                // shaded with what the layer was drawn with, it might lag behind a bit while it waits for its refresh
+                globalShadowUniformPointers[frame][layer] = cache.matrices;
+                continue;
+            }
 
-            const std::array<const glm::vec3, 8> corners = {
-                glm::vec3(m.x, m.y, m.z),
-                glm::vec3(p.x, m.y, m.z),
-                glm::vec3(m.x, p.y, m.z),
-                glm::vec3(m.x, m.y, p.z),
-                glm::vec3(p.x, p.y, m.z),
-                glm::vec3(m.x, p.y, p.z),
-                glm::vec3(p.x, m.y, p.z),
-                glm::vec3(p.x, p.y, p.z),
-            };
-            c2.min = glm::vec3(std::numeric_limits<float>::max());
-            c2.max = glm::vec3(std::numeric_limits<float>::lowest());
-            for(const auto v : corners)
+            cache = {layerLights[layer], globalShadowUniformPointers[frame][layer], true};
+            const GlobalInfo& matrices = cache.matrices;
+            views.push_back({culling::frustum::from_matrix(matrices.projection * matrices.view), shadowPass, layer});
+            cullStatistics.shadowLayersDrawn++;
+        }
+    }
+
+    glm::vec4 render_test::fit_cascades(int frame, const entity::components::target_camera& cam, glm::vec3 direction,
+        uint32_t firstLayer, int cascadeCount)
+    {
+        const GlobalInfo& global = *globalUniformPointers[frame];
+        glm::mat4 cameraInverse = glm::inverse(global.view);
+        float tanY = std::tan(cam.fov / 2.0f);
+        float tanX = tanY * win->swapchainExtent.width / (float) win->swapchainExtent.height;
+        float zNear = cam.zNear;
+        float zFar = std::max(std::min(cam.zFar, CONFIG.shadowDistance), zNear);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0, 0.0, 1.0) : glm::vec3(0.0, 1.0, 0.0);
+        float texelScale = CONFIG.shadowResolution / 2.0f;
+
+        glm::vec4 splits(std::numeric_limits<float>::max());
+        float sliceNear = zNear;
+        for(int c=0; c<cascadeCount; c++)
+        {
+            // practical split scheme, between logarithmic and uniform splits
+            float t = (c+1) / (float) cascadeCount;
+            float sliceFar = cascadeSplitLambda * zNear * std::pow(zFar / zNear, t) +
+                (1.0f - cascadeSplitLambda) * (zNear + (zFar - zNear) * t);
+
+            std::array<glm::vec3, 8> corners;
+            glm::vec3 center(0.0);
+            for(int k=0; k<8; k++)
             {
-                glm::vec3 t = modelUniformPointers[frame][q].transform * glm::vec4(v, 1.0);
-                c2.min = glm::min(c2.min, t);
-                c2.max = glm::max(c2.max, t);
+                float d = (k & 4) ? sliceFar : sliceNear;
+                corners[k] = glm::vec3(cameraInverse * glm::vec4((k & 1 ? d : -d) * tanX, (k & 2 ? d : -d) * tanY, -d, 1.0));
+                center += corners[k] / 8.0f;
             }
-            modelUniformPointers[frame][q].min = glm::vec4(c2.min, 0.0);
-            modelUniformPointers[frame][q].max = glm::vec4(c2.max, 0.0);
+            // a bounding sphere keeps the size of the cascade when the camera turns, which is what makes texel snapping work
+            float radius = 0.0f;
+            for(const auto& corner : corners)
+                radius = std::max(radius, glm::distance(corner, center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            glm::mat4 view = glm::lookAt(center + direction * radius, center, up);
+            // the depth range is as tight as the slice allows, but reaches back to every caster between it and the light
+            float depthNear = 0.0f;
+            if(renderList.casters)
+            {
+                for(int k=0; k<8; k++)
+                {
+                    glm::vec3 corner((k & 1) ? renderList.casterMax.x : renderList.casterMin.x,
+                        (k & 2) ? renderList.casterMax.y : renderList.casterMin.y,
+                        (k & 4) ? renderList.casterMax.z : renderList.casterMin.z);
+                    depthNear = std::min(depthNear, -(view * glm::vec4(corner, 1.0)).z);
+                }
+            }
+            glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, depthNear, 2.0f * radius);
 
-            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, mainDescriptorSets[frame],
-                {0U, (uint32_t)(q*sizeof(ModelInfo))});
-            commandBuffer->draw(24, 1, 0, 0);
+            // moves in whole texels only, so that the edges of shadows do not shimmer while the camera moves
+            glm::vec2 origin = glm::vec2(projection * view * glm::vec4(0.0, 0.0, 0.0, 1.0)) * texelScale;
+            glm::vec2 offset = (glm::round(origin) - origin) / texelScale;
+            projection[3][0] += offset.x;
+            projection[3][1] += offset.y;
+
+            globalShadowUniformPointers[frame][firstLayer+c] = {projection, view};
+
+            // shade.frag selects the cascade by the depth the camera projection wrote
+            glm::vec4 end = global.projection * glm::vec4(0.0, 0.0, -sliceFar, 1.0);
+            splits[c] = end.z / end.w;
+            sliceNear = sliceFar;
         }
+        return splits;
+    }
 
+    vk::Rect2D render_test::light_scissor(int frame, const LightInfo& info) const
+    {
+        vk::Rect2D screen({0, 0}, renderExtent);
+        float radius = info.color.w;
+        if(info.position.w == 0.0f || radius <= 0.0f)
+            return screen;
+
+        // the box around the sphere of influence, it is unbounded on screen as soon as it reaches behind the camera
+        const GlobalInfo& global = *globalUniformPointers[frame];
+        glm::mat4 viewProjection = global.projection * global.view;
+        glm::vec2 lower(std::numeric_limits<float>::max()), upper(std::numeric_limits<float>::lowest());
+        for(int i=0; i<8; i++)
+        {
+            glm::vec3 corner = glm::vec3(info.position) + radius * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if(clip.w <= 0.0f)
+                return screen;
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            lower = glm::min(lower, ndc);
+            upper = glm::max(upper, ndc);
+        }
+
+        glm::vec2 size(renderExtent.width, renderExtent.height);
+        glm::vec2 first = glm::floor((glm::clamp(lower, -1.0f, 1.0f) * 0.5f + 0.5f) * size);
+        glm::vec2 last = glm::ceil((glm::clamp(upper, -1.0f, 1.0f) * 0.5f + 0.5f) * size);
+        if(last.x <= first.x || last.y <= first.y)
+            return vk::Rect2D({0, 0}, {0, 0});
+        return vk::Rect2D({(int32_t)first.x, (int32_t)first.y}, {(uint32_t)(last.x - first.x), (uint32_t)(last.y - first.y)});
+    }
+
+    void render_test::adapt_resolution(float measuredFrameTime)
+    {
+        if(!CONFIG.dynamicResolution)
+        {
+            resolutionScale = 1.0f;
+            return;
+        }
+        // most of the work grows with the number of pixels, so with the square of the scale,
+        // but the measurement is a few frames old and noisy, so only a part of the way is taken
+        float wanted = resolutionScale * std::sqrt(CONFIG.frameTimeBudget / std::max(measuredFrameTime, 0.01f));
+        float minScale = std::clamp(CONFIG.minResolutionScale, 0.1f, 1.0f);
+        resolutionScale = std::clamp(glm::mix(resolutionScale, wanted, 0.1f), minScale, 1.0f);
+    }
+
+    void render_test::record_culling(vk::CommandBuffer commandBuffer, int frame)
+    {
+        // the compute shader only counts instances up, everything else about the draws is known here
+        for(uint32_t pass : {mainPass, shadowPass})
+        {
+            const auto& batches = batches_of(pass);
+            uint32_t commandOffset = pass*objectCapacity[frame];
+            for(uint32_t b=0; b<batches.size(); b++)
+            {
+                drawCommandPointers[frame][commandOffset+b] = vk::DrawIndexedIndirectCommand(batches[b].mesh->indexCount, 0, 0, 0,
+                    batches[b].firstInstance);
+                drawCountPointers[frame][commandOffset+b] = 0;
+            }
+        }
+
+        for(uint32_t v=0; v<views.size(); v++)
+        {
+            const auto& info = views[v];
+            cullViewPointers[frame][v] = {info.frustum.planes, info.pass*objectCapacity[frame], statistics_offset(frame)+v, info.layer, info.pass == shadowPass};
+        }
+
+        uint32_t objectCount = renderList.size();
+        commandBuffer.pushConstants<uint32_t>(cullPipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, objectCount);
+        commandBuffer.dispatch((objectCount+63)/64, views.size(), 1);
+    }
+
+    const std::vector<render_test::draw_batch>& render_test::batches_of(uint32_t pass) const
+    {
+        if(gpuCulling)
+            return pass == mainPass ? renderList.mainBatches : renderList.shadowBatches;
+        return passBatches[pass].batches;
+    }
+
+    void render_test::draw_batches(vk::CommandBuffer commandBuffer, int frame, uint32_t pass, size_t begin, size_t end)
+    {
+        const auto& batches = batches_of(pass);
+        uint32_t commandOffset = pass*objectCapacity[frame];
+
+        for(size_t b=begin; b<end; b++)
+        {
+            commandBuffer.bindVertexBuffers(0, batches[b].mesh->vertexBuffer, {0L});
+            commandBuffer.bindIndexBuffer(batches[b].mesh->indexBuffer, 0, vk::IndexType::eUint32);
+            if(!gpuCulling)
+            {
+                commandBuffer.drawIndexed(batches[b].mesh->indexCount, batches[b].instanceCount, 0, 0, batches[b].firstInstance);
+                continue;
+            }
+
+            // the model buffers are separate, so it is still one call per batch, but culled batches cost nothing on the GPU
+            vk::DeviceSize offset = (commandOffset+b)*sizeof(vk::DrawIndexedIndirectCommand);
+            if(drawIndirectCount)
+                commandBuffer.drawIndexedIndirectCount(drawCommandBuffers[frame], offset,
+                    drawCountBuffers[frame], (commandOffset+b)*sizeof(uint32_t), 1, sizeof(vk::DrawIndexedIndirectCommand));
+            else
+                commandBuffer.drawIndexedIndirect(drawCommandBuffers[frame], offset, 1, sizeof(vk::DrawIndexedIndirectCommand));
+        }
+    }
+
+    void render_test::record_shadow(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end)
+    {
+        // secondary command buffers do not inherit any state
+        commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, (float)CONFIG.shadowResolution, (float)CONFIG.shadowResolution, 0.0f, 1.0f));
+        commandBuffer.setScissor(0, vk::Rect2D({0,0}, {CONFIG.shadowResolution, CONFIG.shadowResolution}));
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.get());
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, shadowDescriptorSets[frame], 0U);
+        commandBuffer.bindVertexBuffers(1, instanceBuffers[frame], {0UL});
+
+        // the first slice clears the layers that are drawn again, all others keep their content
+        if(begin == 0)
+        {
+            std::vector<vk::ClearRect> rects;
+            for(const auto& v : views)
+            {
+                if(v.pass == shadowPass)
+                    rects.push_back(vk::ClearRect(vk::Rect2D({0,0}, {CONFIG.shadowResolution, CONFIG.shadowResolution}), v.layer, 1));
+            }
+            commandBuffer.clearAttachments(vk::ClearAttachment(vk::ImageAspectFlagBits::eDepth, 0, vk::ClearDepthStencilValue(1.0f, 0)), rects);
+        }
+        draw_batches(commandBuffer, frame, shadowPass, begin, end);
+    }
+
+    void render_test::record_prepass(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end)
+    {
+        commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, renderExtent.width, renderExtent.height, 0.0f, 1.0f));
+        commandBuffer.setScissor(0, vk::Rect2D({0,0}, renderExtent));
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, prepassPipeline.get());
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, mainDescriptorSets[frame], 0U);
+        commandBuffer.bindVertexBuffers(1, instanceBuffers[frame], {0UL});
+
+        draw_batches(commandBuffer, frame, mainPass, begin, end);
+    }
+
+    void render_test::record_main(vk::CommandBuffer commandBuffer, int frame, size_t begin, size_t end)
+    {
+        commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, renderExtent.width, renderExtent.height, 0.0f, 1.0f));
+        commandBuffer.setScissor(0, vk::Rect2D({0,0}, renderExtent));
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, mainPipeline.get());
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, mainDescriptorSets[frame], 0U);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 1, textureDescriptorSet, {});
+        commandBuffer.bindVertexBuffers(1, instanceBuffers[frame], {0UL});
+
+        draw_batches(commandBuffer, frame, mainPass, begin, end);
+    }
+
+    void render_test::record_hitboxes(vk::CommandBuffer commandBuffer, int frame)
+    {
+        commandBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, renderExtent.width, renderExtent.height, 0.0f, 1.0f));
+        commandBuffer.setScissor(0, vk::Rect2D({0,0}, renderExtent));
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, hitboxPipeline.get());
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mainPipelineLayout.get(), 0, mainDescriptorSets[frame], 0U);
+
+        // the only job touching collision components, the registry is not modified while recording
+        for(uint32_t i=0; i<renderList.size(); i++)
+        {
+            if(!(renderList.flags[i] & Hitbox))
+                continue;
+            // the world space bounds were already written to the model buffer by extract()
+            auto& c2 = entities.get<entity::components::collision>(renderList.entities[i]);
+            uint32_t q = renderList.slots[i];
+            c2.min = glm::vec3(modelPointers[frame][q].min);
+            c2.max = glm::vec3(modelPointers[frame][q].max);
+
+            commandBuffer.draw(24, 1, 0, q);
+        }
+    }
+
+
+    void render_test::render(int frame, int image, vk::Semaphore imageAvailable, vk::Semaphore renderFinished, vk::Fence fence)
+    {
+        update_assets();
+
+        vk::UniqueCommandBuffer& commandBuffer = commandBuffers[frame];
+        commandBuffer->begin(vk::CommandBufferBeginInfo());
+        if(profiler->begin_frame(commandBuffer.get(), frame))
+        {
+            const auto* main = profiler->find("Main Render");
+            mainPassTime = main ? main->time : 0.0f;
+            frameTime = profiler->results().front().time;
+            // adapt_resolution() damps the change on its own, the smoothed time would only add lag
+            adapt_resolution(profiler->results().front().lastTime);
+        }
+        // the targets are as large as the swapchain, only this part of them is rendered to
+        renderExtent = vk::Extent2D(
+            std::max(1U, (uint32_t)std::lround(win->swapchainExtent.width * resolutionScale)),
+            std::max(1U, (uint32_t)std::lround(win->swapchainExtent.height * resolutionScale)));
+
+        cullStatistics = {};
+        extract(frame);
+        update_views(frame);
+        update_shadow_cache(frame);
+
+        if(!shadowMapsReady[frame])
+        {
+            // the shadow pass loads the layers it does not draw, so the image needs a defined layout from the start
+            vk::ImageMemoryBarrier barrier({}, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, shadowBuffers[frame]->image,
+                vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, maxShadowLayers));
+            commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eFragmentShader,
+                {}, {}, {}, barrier);
+            shadowMapsReady[frame] = true;
+        }
+
+        // from here on the render list is only read, so the passes are culled and recorded on the workers
+        recorder->begin_frame(frame);
+        auto record_slices = [this, frame](std::vector<std::future<vk::CommandBuffer>>& out, vk::CommandBufferInheritanceInfo inheritance,
+            size_t batchCount, void (render_test::*fn)(vk::CommandBuffer, int, size_t, size_t))
+        {
+            size_t sliceCount = std::clamp<size_t>(batchCount/minSliceBatches, 1, recorder->thread_count());
+            for(size_t i=0; i<sliceCount; i++)
+            {
+                size_t begin = batchCount*i/sliceCount;
+                size_t end = batchCount*(i+1)/sliceCount;
+                out.push_back(recorder->record(frame, inheritance, [this, frame, fn, begin, end](vk::CommandBuffer cmd){
+                    (this->*fn)(cmd, frame, begin, end);
+                }));
+            }
+        };
+
+        // all shadow casting lights are drawn into their layers of one image by a single pass
+        bool shadows = views.size() > 1;
+        std::vector<std::future<vk::CommandBuffer>> shadowCommands;
+        if(shadows)
+        {
+            vk::CommandBufferInheritanceInfo inheritance(shadowRenderPass.get(), 0, shadowFramebuffers[frame].get(), false, {}, profiler->inherited_statistics());
+            if(gpuCulling)
+                record_slices(shadowCommands, inheritance, batches_of(shadowPass).size(), &render_test::record_shadow);
+            else
+            {
+                // culling against every light is the bulk of the work, so it stays on the worker
+                shadowCommands.push_back(recorder->record(frame, inheritance, [this, frame](vk::CommandBuffer cmd){
+                    build_batches(frame, shadowPass);
+                    record_shadow(cmd, frame, 0, passBatches[shadowPass].batches.size());
+                }));
+            }
+        }
+
+        if(!gpuCulling)
+            build_batches(frame, mainPass);
+        std::vector<std::future<vk::CommandBuffer>> mainCommands;
+        {
+            vk::CommandBufferInheritanceInfo inheritance(mainRenderPass.get(), 0, mainFramebuffers[frame].get(), false, {}, profiler->inherited_statistics());
+            // secondary command buffers are executed in order, so the whole depth pre-pass comes first
+            if(depthPrepass)
+                record_slices(mainCommands, inheritance, batches_of(mainPass).size(), &render_test::record_prepass);
+            record_slices(mainCommands, inheritance, batches_of(mainPass).size(), &render_test::record_main);
+            mainCommands.push_back(recorder->record(frame, inheritance, [this, frame](vk::CommandBuffer cmd){
+                record_hitboxes(cmd, frame);
+            }));
+        }
+
+        if(gpuCulling)
+        {
+            profiler->begin_scope(commandBuffer.get(), "Culling");
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline.get());
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout.get(), 0, cullDescriptorSets[frame], {});
+
+            // counted by the GPU the last time this frame was rendered, it has finished since
+            uint32_t* visibleCounts = drawCountPointers[frame]+statistics_offset(frame);
+            cullStatistics.mainVisible = visibleCounts[0];
+            cullStatistics.shadowVisible = std::accumulate(visibleCounts+1, visibleCounts+viewCount, 0U);
+            std::fill_n(visibleCounts, viewCount, 0);
+
+            record_culling(commandBuffer.get(), frame);
+
+            vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead);
+            commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+                {}, barrier, {}, {});
+            profiler->end_scope(commandBuffer.get());
+        }
+
+        if(shadows)
+        {
+            profiler->begin_scope(commandBuffer.get(), "Shadow Render");
+            commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(shadowRenderPass.get(), shadowFramebuffers[frame].get(),
+                vk::Rect2D({0, 0}, {CONFIG.shadowResolution, CONFIG.shadowResolution}), {}), vk::SubpassContents::eSecondaryCommandBuffers);
+            std::vector<vk::CommandBuffer> shadowSecondaries;
+            for(auto& f : shadowCommands)
+                shadowSecondaries.push_back(f.get());
+            commandBuffer->executeCommands(shadowSecondaries);
+            commandBuffer->endRenderPass();
+            profiler->end_scope(commandBuffer.get());
+
+            cullStatistics.shadowTotal = renderList.casters * (views.size()-1);
+            if(!gpuCulling)
+                cullStatistics.shadowVisible = passBatches[shadowPass].drawn;
+        }
+
+         std::array<vk::ClearValue, 4> mainClear = {
+            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
+            vk::ClearColorValue(std::array<int32_t, 4>{0, 0, 0, 0}),
+            vk::ClearDepthStencilValue(1.0f, 0),
+            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f})
+        };
+
+        profiler->begin_scope(commandBuffer.get(), "Main Render");
+        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(mainRenderPass.get(), mainFramebuffers[frame].get(),
+            vk::Rect2D({0, 0}, renderExtent), mainClear), vk::SubpassContents::eSecondaryCommandBuffers);
+        std::vector<vk::CommandBuffer> mainSecondaries;
+        for(auto& f : mainCommands)
+            mainSecondaries.push_back(f.get());
+        commandBuffer->executeCommands(mainSecondaries);
         commandBuffer->endRenderPass();
-        commandBuffer->endDebugUtilsLabelEXT();
+        profiler->end_scope(commandBuffer.get());
+
+        cullStatistics.mainTotal = renderList.size();
+        if(!gpuCulling)
+            cullStatistics.mainVisible = passBatches[mainPass].drawn;
 
-        commandBuffer->beginDebugUtilsLabelEXT(label.setPLabelName("Shading"));
-        std::array<vk::ClearValue, 3> shadeClear = {
+        // the state of the primary command buffer is undefined after executing secondary ones
+        {
+            vk::Viewport viewport(0.0f, 0.0f, renderExtent.width, renderExtent.height, 0.0f, 1.0f);
+            vk::Rect2D scissor({0,0}, renderExtent);
+            commandBuffer->setViewport(0, viewport);
+            commandBuffer->setScissor(0, scissor);
+        }
+
+        int filterRadius = std::clamp(CONFIG.shadowFilterRadius, 0, maxFilterRadius);
+        if(tiledLighting)
+        {
+            profiler->begin_scope(commandBuffer.get(), "Tiled Lighting");
+            // every pixel is written again, so the content from the last time this frame was rendered is discarded
+            vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+            vk::ImageMemoryBarrier toWrite({}, vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, litBuffers[frame]->image, range);
+            commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eComputeShader,
+                {}, {}, {}, toWrite);
+
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, lightingPipelines[filterRadius].get());
+            std::array<vk::DescriptorSet, 2> sets = {lightingDescriptorSets[frame], shadowMapDescriptorSets[frame]};
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, lightingPipelineLayout.get(), 0, sets, {});
+            const GlobalInfo& global = *globalUniformPointers[frame];
+            LightingPush push{glm::inverse(global.projection * global.view), glm::uvec2(renderExtent.width, renderExtent.height), lightCount};
+            commandBuffer->pushConstants<LightingPush>(lightingPipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, push);
+            commandBuffer->dispatch((renderExtent.width+lightTileSize-1)/lightTileSize,
+                (renderExtent.height+lightTileSize-1)/lightTileSize, 1);
+
+            vk::ImageMemoryBarrier toRead(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, litBuffers[frame]->image, range);
+            commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eFragmentShader,
+                {}, {}, {}, toRead);
+            profiler->end_scope(commandBuffer.get());
+        }
+
+        profiler->begin_scope(commandBuffer.get(), "Shading");
+        std::array<vk::ClearValue, 4> shadeClear = {
+            vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
             vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
             vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f}),
             vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f})
         };
         commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(shadeRenderPass.get(), shadeFramebuffers[frame].get(),
-            vk::Rect2D({0, 0}, win->swapchainExtent), shadeClear), vk::SubpassContents::eInline);
-        commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, shadePipeline.get());
-        for(auto [entity, position, light] : lightView.each())
+            vk::Rect2D({0, 0}, renderExtent), shadeClear), vk::SubpassContents::eInline);
+        if(tiledLighting)
+        {
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, composePipeline.get());
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightingPipelineLayout.get(), 0, lightingDescriptorSets[frame], {});
+            commandBuffer->draw(6, 1, 0, 0);
+        }
+        else
         {
-            int l = lightDescriptors[entity];
+            commandBuffer->setScissor(0, vk::Rect2D({0, 0}, renderExtent));
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, ambientPipeline.get());
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shadePipelineLayout.get(), 0, shadeDescriptorSets[frame], {0U});
+            commandBuffer->draw(6, 1, 0, 0);
 
-            lightUniformPointers[frame][l].position = glm::vec4((glm::vec3)position, 1.0);
-            lightUniformPointers[frame][l].color = glm::vec4(light.color, 1.0);
-            lightUniformPointers[frame][l].lightMatrix = globalShadowUniformPointers[frame][l].projection * globalShadowUniformPointers[frame][l].view;
-            lightUniformPointers[frame][l].globalInverse = glm::inverse(globalUniformPointers[frame]->projection * globalUniformPointers[frame]->view);
+            vk::Pipeline boundShadePipeline{};
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shadePipelineLayout.get(), 1, shadowMapDescriptorSets[frame], {});
+            for(uint32_t l=0; l<lightCount; l++)
+            {
+                vk::Rect2D scissor = light_scissor(frame, light_info(frame, l));
+                if(scissor.extent.width == 0 || scissor.extent.height == 0)
+                    continue;
+                commandBuffer->setScissor(0, scissor);
 
-            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shadePipelineLayout.get(), 0, shadeDescriptorSets[frame], {(uint32_t)(l*sizeof(LightInfo))});
-            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shadePipelineLayout.get(), 1, shadowMapDescriptorSets[frame][l], {});
+                // update_views() only gives lights layers that cast shadows and fit into the shadow map
+                vk::Pipeline shadePipeline = shadePipelines[filterRadius][light_info(frame, l).shadow.y > 0].get();
+                if(shadePipeline != boundShadePipeline)
+                {
+                    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, shadePipeline);
+                    boundShadePipeline = shadePipeline;
+                }
+
+                commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shadePipelineLayout.get(), 0, shadeDescriptorSets[frame], {(uint32_t)(l*lightInfoStride)});
+                commandBuffer->draw(6, 1, 0, 0);
+            }
+        }
+        commandBuffer->endRenderPass();
+        profiler->end_scope(commandBuffer.get());
+
+        // from the rendered part of the scene image to the whole swapchain image, the overlay is drawn at full resolution
+        profiler->begin_scope(commandBuffer.get(), "Upscale");
+        {
+            vk::Viewport viewport(0.0f, 0.0f, win->swapchainExtent.width, win->swapchainExtent.height, 0.0f, 1.0f);
+            vk::Rect2D scissor({0,0}, win->swapchainExtent);
+            commandBuffer->setViewport(0, viewport);
+            commandBuffer->setScissor(0, scissor);
+        }
+        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(upscalePass.get(), upscaleFramebuffers[image].get(),
+            vk::Rect2D({0, 0}, win->swapchainExtent), {}), vk::SubpassContents::eInline);
+        {
+            glm::vec2 size(sceneBuffers[frame]->width, sceneBuffers[frame]->height);
+            glm::vec2 rendered(renderExtent.width, renderExtent.height);
+            UpscalePush push{rendered / size, (rendered - glm::vec2(0.5f)) / size};
+            commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, upscalePipeline.get());
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, upscalePipelineLayout.get(), 0, upscaleDescriptorSets[frame], {});
+            commandBuffer->pushConstants<UpscalePush>(upscalePipelineLayout.get(), vk::ShaderStageFlagBits::eFragment, 0, push);
             commandBuffer->draw(6, 1, 0, 0);
         }
         commandBuffer->endRenderPass();
-        commandBuffer->endDebugUtilsLabelEXT();
+        profiler->end_scope(commandBuffer.get());
 
-        commandBuffer->beginDebugUtilsLabelEXT(label.setPLabelName("Overlay Render"));
-        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(overlayPass.get(), overlayFramebuffers[frame].get(),
+        profiler->begin_scope(commandBuffer.get(), "Overlay Render");
+        commandBuffer->beginRenderPass(vk::RenderPassBeginInfo(overlayPass.get(), overlayFramebuffers[image].get(),
             vk::Rect2D({0, 0}, win->swapchainExtent), {}), vk::SubpassContents::eInline);
 
         gui_render_context ctx(commandBuffer.get(), frame, font.get());
@@ -791,12 +1920,14 @@ namespace render::phases
         font->finish(frame);
 
         commandBuffer->endRenderPass();
-        commandBuffer->endDebugUtilsLabelEXT();
+        profiler->end_scope(commandBuffer.get());
 
+        profiler->end_frame(commandBuffer.get());
         commandBuffer->end();
 
         vk::PipelineStageFlags waitFlags = vk::PipelineStageFlagBits::eColorAttachmentOutput;
         vk::SubmitInfo submit_info(imageAvailable, waitFlags, commandBuffer.get(), renderFinished);
+        std::scoped_lock<std::mutex> l(*queueMutex);
         graphicsQueue.submit(submit_info, fence);
     }
 }
@@ -6,14 +6,19 @@
 #include <spdlog/spdlog.h>
 #include <spng.h>
 
+#include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <chrono>
+#include <stdexcept>
+#include <algorithm>
 
 namespace render
 {
     resource_loader::resource_loader(vk::Device device, vma::Allocator allocator,
         uint32_t transferFamily, uint32_t graphicsFamily,
-        std::vector<vk::Queue> queues) : device(device), allocator(allocator), transferFamily(transferFamily), graphicsFamily(graphicsFamily)
+        std::vector<vk::Queue> queues, std::mutex* sharedQueueMutex) : device(device), allocator(allocator),
+        transferFamily(transferFamily), graphicsFamily(graphicsFamily), sharedQueueMutex(sharedQueueMutex)
     {
         int index = 0;
         for(auto& queue : queues)
@@ -34,46 +39,60 @@ namespace render
         }
     }
 
-    std::future<void> resource_loader::loadTexture(texture* image, std::string filename)
+    std::future<void> resource_loader::enqueue(LoadTask task)
     {
         std::future<void> f;
         {
             std::scoped_lock<std::mutex> l(lock);
-            tasks.push(LoadTask{.type = LoadType::Texture, .src = filename, .dst = image, .promise = std::promise<void>()});
-            f = tasks.back().promise.get_future();
+            task.enqueued = std::chrono::steady_clock::now();
+            f = task.promise.get_future();
+            tasks.push(std::move(task));
+
+            std::scoped_lock<std::mutex> s(statsLock);
+            if(tasksQueued++ == 0)
+                firstEnqueue = tasks.back().enqueued;
+            bytesQueued += tasks.back().bytes;
+            maxQueueDepth = std::max(maxQueueDepth, tasks.size());
         }
         cv.notify_one();
         return f;
     }
 
+    static size_t fileSize(const std::string& path)
+    {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+
+    std::future<void> resource_loader::loadTexture(texture* image, std::string filename)
+    {
+        return enqueue(LoadTask{.type = LoadType::Texture, .src = filename, .dst = image, .promise = std::promise<void>(),
+            .bytes = fileSize("assets/textures/"+filename)});
+    }
+
     std::future<void> resource_loader::loadTexture(texture* image, LoaderFunction func)
     {
-        std::future<void> f;
-        {
-            std::scoped_lock<std::mutex> l(lock);
-            tasks.push(LoadTask{.type = LoadType::Texture, .src = func, .dst = image, .promise = std::promise<void>()});
-            f = tasks.back().promise.get_future();
-        }
-        cv.notify_one();
-        return f;
+        return enqueue(LoadTask{.type = LoadType::Texture, .src = func, .dst = image, .promise = std::promise<void>(),
+            .bytes = static_cast<size_t>(image->width) * image->height * 4});
     }
 
     std::future<void> resource_loader::loadModel(model* model, std::string filename)
     {
-        std::future<void> f;
-        {
-            std::scoped_lock<std::mutex> l(lock);
-            tasks.push(LoadTask{.type = LoadType::Model, .src = filename, .dst = model, .promise = std::promise<void>()});
-            f = tasks.back().promise.get_future();
-        }
-        cv.notify_one();
-        return f;
+        return enqueue(LoadTask{.type = LoadType::Model, .src = filename, .dst = model, .promise = std::promise<void>(),
+            .bytes = fileSize("assets/models/"+filename)});
     }
 
     // Ugly hack to get PNG size BEFORE loading it, so we can create a vk::Image and a vk::ImageView in advance
     vk::Extent2D resource_loader::getImageSize(std::string filename)
     {
         std::ifstream in("assets/textures/"+filename, std::ios_base::binary);
+        if(!in)
+        {
+            // the load task fails as well, this only has to be a valid size for the placeholder image
+            spdlog::warn("[Resource Loader] Cannot read texture \"{}\"", filename);
+            return vk::Extent2D{1, 1};
+        }
 
         // 32 bytes is enough to capture the IHDR chunk (it's guaranteed to be the first chunk) which is all we need
         std::vector<char> data(32);
@@ -89,20 +108,35 @@ namespace render
         return vk::Extent2D{ihdr.width, ihdr.height};
     }
 
+    using load_clock = std::chrono::steady_clock;
+
+    static size_t imageSize(const texture* tex)
+    {
+        return static_cast<size_t>(tex->width) * tex->height * 4;
+    }
+
     void load_texture(
-        int index, LoadTask& task,
+        int index, LoadTask& task, LoadMetrics& metrics,
         vk::Device device, vma::Allocator allocator, vma::Allocation allocation,
         vk::CommandBuffer commandBuffer, spng_ctx* ctx,
         uint8_t* decodeBuffer, size_t stagingSize, vk::Buffer stagingBuffer)
     {
         texture* tex = std::get<texture*>(task.dst);
+        auto t0 = load_clock::now();
         if(std::holds_alternative<std::string>(task.src))
         {
             std::ifstream in("assets/textures/"+std::get<std::string>(task.src), std::ios_base::ate | std::ios_base::binary);
+            if(!in)
+                throw std::runtime_error("cannot read texture \""+std::get<std::string>(task.src)+"\"");
             size_t size = in.tellg();
             std::vector<char> data(size);
             in.seekg(0);
             in.read(data.data(), size);
+            metrics.fileBytes = size;
+
+            auto t1 = load_clock::now();
+            metrics.read = t1 - t0;
+            t0 = t1;
 
             spng_set_png_buffer(ctx, data.data(), data.size());
 
@@ -117,11 +151,16 @@ namespace render
         }
         else
         {
-            std::fill(decodeBuffer, decodeBuffer+stagingSize, 0x00);
+            std::fill(decodeBuffer, decodeBuffer+std::min(imageSize(tex), stagingSize), 0x00);
             std::get<LoaderFunction>(task.src)(decodeBuffer, stagingSize);
         }
+        auto t1 = load_clock::now();
+        metrics.decode = t1 - t0;
+
+        // only copy what the image actually occupies, small dynamic textures should not pay for the whole staging buffer
+        metrics.uploadBytes = std::min(imageSize(tex), stagingSize);
         void* buf = allocator.mapMemory(allocation);
-        std::copy(decodeBuffer, decodeBuffer+stagingSize, (char*)buf);
+        std::copy(decodeBuffer, decodeBuffer+metrics.uploadBytes, (char*)buf);
         allocator.unmapMemory(allocation);
 
         commandBuffer.begin(vk::CommandBufferBeginInfo());
@@ -144,6 +183,7 @@ namespace render
                 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
                 tex->image, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
         commandBuffer.end();
+        metrics.staging = load_clock::now() - t1;
 
         if(std::holds_alternative<std::string>(task.src))
         {
@@ -160,12 +200,27 @@ namespace render
     }
 
     void load_model(
-        int index, LoadTask& task,
+        int index, LoadTask& task, LoadMetrics& metrics,
         vk::Device device, vma::Allocator allocator, vma::Allocation allocation,
         vk::CommandBuffer commandBuffer,
         size_t stagingSize, vk::Buffer stagingBuffer)
     {
-        std::ifstream obj("assets/models/"+std::get<std::string>(task.src));
+        auto t0 = load_clock::now();
+        std::string source;
+        {
+            std::ifstream file("assets/models/"+std::get<std::string>(task.src), std::ios_base::ate | std::ios_base::binary);
+            if(!file)
+                throw std::runtime_error("cannot read model \""+std::get<std::string>(task.src)+"\"");
+            size_t size = file.tellg();
+            source.resize(size);
+            file.seekg(0);
+            file.read(source.data(), size);
+            metrics.fileBytes = size;
+        }
+        auto t1 = load_clock::now();
+        metrics.read = t1 - t0;
+
+        std::istringstream obj(std::move(source));
         std::vector<vertex_data> vertices;
         std::vector<uint32_t> indices;
         load_obj(obj, vertices, indices);
@@ -182,6 +237,9 @@ namespace render
         vk::DeviceSize vertexSize = vertices.size() * sizeof(vertex_data);
         vk::DeviceSize indexOffset = vertexSize;
         vk::DeviceSize indexSize = indices.size() * sizeof(uint32_t);
+        metrics.uploadBytes = vertexSize + indexSize;
+        auto t2 = load_clock::now();
+        metrics.decode = t2 - t1;
 
         void* buf = allocator.mapMemory(allocation);
         std::copy(vertices.begin(), vertices.end(), (vertex_data*)((uint8_t*)buf+vertexOffset));
@@ -193,6 +251,7 @@ namespace render
         commandBuffer.copyBuffer(stagingBuffer, mesh->vertexBuffer, region.setSrcOffset(vertexOffset).setSize(vertexSize));
         commandBuffer.copyBuffer(stagingBuffer, mesh->indexBuffer, region.setSrcOffset(indexOffset).setSize(indexSize));
         commandBuffer.end();
+        metrics.staging = load_clock::now() - t2;
 
         debugName(device, mesh->vertexBuffer, "Model \""+std::get<std::string>(task.src)+"\" Vertex Buffer");
         debugName(device, mesh->indexBuffer, "Model \""+std::get<std::string>(task.src)+"\" Index Buffer");
@@ -228,35 +287,71 @@ namespace render
                 tasks.pop();
                 l.unlock();
 
-                spdlog::debug("[Resource Loader {}] Loading {}", index,
-                    std::holds_alternative<std::string>(task.src) ? std::get<std::string>(task.src) : "dynamic resource");
-                auto t0 = std::chrono::high_resolution_clock::now();
+                LoadMetrics metrics{
+                    .name = std::holds_alternative<std::string>(task.src) ? std::get<std::string>(task.src) : "dynamic resource",
+                    .type = task.type,
+                    .thread = index
+                };
+                spdlog::debug("[Resource Loader {}] Loading {}", index, metrics.name);
+
+                auto t0 = load_clock::now();
+                metrics.queueWait = t0 - task.enqueued;
+                try
                 {
                     if(task.type == Texture)
                     {
-                        load_texture(index, task, device, allocator, allocation, commandBuffer.get(), ctx, cpuBuffer, stagingSize, stagingBuffer);
+                        load_texture(index, task, metrics, device, allocator, allocation, commandBuffer.get(), ctx, cpuBuffer, stagingSize, stagingBuffer);
                     }
                     else if(task.type == Model)
                     {
-                        load_model(index, task, device, allocator, allocation, commandBuffer.get(), stagingSize, stagingBuffer);
+                        load_model(index, task, metrics, device, allocator, allocation, commandBuffer.get(), stagingSize, stagingBuffer);
                     }
+                    auto tSubmit = load_clock::now();
                     std::array<vk::SubmitInfo, 1> submits = {
                         vk::SubmitInfo({}, {}, commandBuffer.get(), {})
                     };
-                    queue.submit(submits, fence.get());
+                    {
+                        std::unique_lock<std::mutex> q = sharedQueueMutex ? std::unique_lock<std::mutex>(*sharedQueueMutex) : std::unique_lock<std::mutex>();
+                        queue.submit(submits, fence.get());
+                    }
                     vk::Result result = device.waitForFences(fence.get(), true, UINT64_MAX);
                     if(result != vk::Result::eSuccess)
                     {
                         spdlog::error("[Resource Loader {}] Waiting for fence failed: {}", index, vk::to_string(result));
                     }
+                    metrics.transfer = load_clock::now() - tSubmit;
                     device.resetCommandPool(pool.get());
                     device.resetFences(fence.get());
                     task.promise.set_value();
                 }
-                auto t1 = std::chrono::high_resolution_clock::now();
+                catch(const std::exception& e)
+                {
+                    // the task's owner sees the failure through its future, the asset stays unusable
+                    spdlog::error("[Resource Loader {}] Failed to load {}: {}", index, metrics.name, e.what());
+                    device.resetCommandPool(pool.get());
+                    device.resetFences(fence.get()); // the submit might have failed after the fence was used
+                    task.promise.set_exception(std::current_exception());
+                    metrics.failed = true;
+                }
+                auto t1 = load_clock::now();
                 auto time = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-                spdlog::debug("[Resource Loader {}] Loaded {} in {} ms", index,
-                    std::holds_alternative<std::string>(task.src) ? std::get<std::string>(task.src) : "dynamic resource", time);
+                if(!metrics.failed)
+                    spdlog::debug("[Resource Loader {}] Loaded {} in {} ms (read/decode/staging/transfer: {}/{}/{}/{} us, waited {} us)", index,
+                        metrics.name, time,
+                        std::chrono::duration_cast<std::chrono::microseconds>(metrics.read).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(metrics.decode).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(metrics.staging).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(metrics.transfer).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(metrics.queueWait).count());
+
+                // failed tasks are done as well, otherwise the progress would never be complete
+                {
+                    std::scoped_lock<std::mutex> s(statsLock);
+                    tasksFailed += metrics.failed;
+                    completed.push_back(std::move(metrics));
+                    lastCompletion = t1;
+                    bytesCompleted += task.bytes;
+                }
 
                 l.lock();
             }
@@ -266,4 +361,124 @@ namespace render
         allocator.destroyBuffer(stagingBuffer, allocation);
         spdlog::info("[Resource Loader {}]: Quit", index);
     }
+
+    LoaderProgress resource_loader::progress()
+    {
+        std::scoped_lock<std::mutex> s(statsLock);
+        return LoaderProgress{
+            .tasksQueued = tasksQueued,
+            .tasksCompleted = completed.size(),
+            .tasksFailed = tasksFailed,
+            .bytesQueued = bytesQueued,
+            .bytesCompleted = bytesCompleted
+        };
+    }
+
+    LoaderStatistics resource_loader::statistics()
+    {
+        LoaderStatistics stats{};
+        {
+            std::scoped_lock<std::mutex> l(lock);
+            stats.queueDepth = tasks.size();
+        }
+
+        std::vector<std::chrono::nanoseconds> latencies;
+        {
+            std::scoped_lock<std::mutex> s(statsLock);
+            stats.tasksQueued = tasksQueued;
+            stats.tasksCompleted = completed.size();
+            stats.tasksFailed = tasksFailed;
+            stats.maxQueueDepth = maxQueueDepth;
+
+            // failed tasks stopped somewhere in between, their times and sizes would skew the rest
+            latencies.reserve(completed.size());
+            for(const auto& m : completed)
+            {
+                if(m.failed)
+                    continue;
+                stats.fileBytes += m.fileBytes;
+                stats.uploadBytes += m.uploadBytes;
+                stats.queueWait += m.queueWait;
+                stats.read += m.read;
+                stats.decode += m.decode;
+                stats.staging += m.staging;
+                stats.transfer += m.transfer;
+                latencies.push_back(m.latency());
+            }
+            if(!completed.empty())
+                stats.wallTime = lastCompletion - firstEnqueue;
+        }
+
+        if(!latencies.empty())
+        {
+            auto percentile = [&latencies](double p){
+                auto it = latencies.begin() + static_cast<size_t>(p * (latencies.size() - 1));
+                std::nth_element(latencies.begin(), it, latencies.end());
+                return *it;
+            };
+            stats.p50Latency = percentile(0.50);
+            stats.p99Latency = percentile(0.99);
+            stats.maxLatency = *std::max_element(latencies.begin(), latencies.end());
+        }
+        if(stats.wallTime.count() > 0)
+        {
+            stats.throughput = (stats.uploadBytes / (1024.0 * 1024.0)) / std::chrono::duration<double>(stats.wallTime).count();
+        }
+        return stats;
+    }
+
+    std::vector<LoadMetrics> resource_loader::metrics()
+    {
+        std::scoped_lock<std::mutex> s(statsLock);
+        return completed;
+    }
+
+    static std::string json_escape(std::string_view str)
+    {
+        std::string out;
+        out.reserve(str.size());
+        for(char c : str)
+        {
+            if(c == '"' || c == '\\')
+                out.push_back('\\');
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    void resource_loader::writeStatistics(std::ostream& out)
+    {
+        auto us = [](std::chrono::nanoseconds d){
+            return std::chrono::duration<double, std::micro>(d).count();
+        };
+        auto stats = statistics();
+        auto entries = metrics();
+
+        out << "{\n";
+        out << "  \"tasksQueued\": " << stats.tasksQueued << ",\n";
+        out << "  \"tasksCompleted\": " << stats.tasksCompleted << ",\n";
+        out << "  \"tasksFailed\": " << stats.tasksFailed << ",\n";
+        out << "  \"queueDepth\": " << stats.queueDepth << ",\n";
+        out << "  \"maxQueueDepth\": " << stats.maxQueueDepth << ",\n";
+        out << "  \"fileBytes\": " << stats.fileBytes << ",\n";
+        out << "  \"uploadBytes\": " << stats.uploadBytes << ",\n";
+        out << "  \"wallTimeUs\": " << us(stats.wallTime) << ",\n";
+        out << "  \"throughputMiBs\": " << stats.throughput << ",\n";
+        out << "  \"latencyUs\": {\"p50\": " << us(stats.p50Latency) << ", \"p99\": " << us(stats.p99Latency) << ", \"max\": " << us(stats.maxLatency) << "},\n";
+        out << "  \"totalUs\": {\"queueWait\": " << us(stats.queueWait) << ", \"read\": " << us(stats.read) << ", \"decode\": " << us(stats.decode)
+            << ", \"staging\": " << us(stats.staging) << ", \"transfer\": " << us(stats.transfer) << "},\n";
+        out << "  \"tasks\": [";
+        for(size_t i=0; i<entries.size(); i++)
+        {
+            const auto& m = entries[i];
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    {\"name\": \"" << json_escape(m.name) << "\", \"type\": " << static_cast<int>(m.type) << ", \"thread\": " << m.thread
+                << ", \"queueWaitUs\": " << us(m.queueWait) << ", \"readUs\": " << us(m.read) << ", \"decodeUs\": " << us(m.decode)
+                << ", \"stagingUs\": " << us(m.staging) << ", \"transferUs\": " << us(m.transfer)
+                << ", \"fileBytes\": " << m.fileBytes << ", \"uploadBytes\": " << m.uploadBytes
+                << ", \"failed\": " << (m.failed ? "true" : "false") << "}";
+        }
+        out << (entries.empty() ? "]\n" : "\n  ]\n");
+        out << "}\n";
+    }
 }
@@ -4,11 +4,12 @@
 namespace render
 {
     texture::texture(vk::Device device, vma::Allocator allocator, int width, int height,
-        vk::ImageUsageFlags usage, vk::Format format, vk::SampleCountFlagBits sampleCount, bool transfer, vk::ImageAspectFlags aspects)
-        : device(device), allocator(allocator), width(width), height(height)
+        vk::ImageUsageFlags usage, vk::Format format, vk::SampleCountFlagBits sampleCount, bool transfer, vk::ImageAspectFlags aspects,
+        uint32_t layers)
+        : device(device), allocator(allocator), width(width), height(height), layers(layers)
     {
         vk::ImageCreateInfo image_info({}, vk::ImageType::e2D, format,
-            {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1}, 1, 1,
+            {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1}, 1, layers,
             sampleCount, vk::ImageTiling::eOptimal,
             usage | (transfer?vk::ImageUsageFlagBits::eTransferDst:vk::ImageUsageFlagBits{}),
             vk::SharingMode::eExclusive);
@@ -18,8 +19,8 @@ namespace render
         image = i;
         allocation = a;
 
-        vk::ImageViewCreateInfo view_info({}, image, vk::ImageViewType::e2D, format,
-            vk::ComponentMapping(), vk::ImageSubresourceRange(aspects, 0, 1, 0, 1));
+        vk::ImageViewCreateInfo view_info({}, image, layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D, format,
+            vk::ComponentMapping(), vk::ImageSubresourceRange(aspects, 0, 1, 0, layers));
         imageView = device.createImageViewUnique(view_info);
     }
 
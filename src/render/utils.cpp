@@ -19,4 +19,18 @@ namespace render
         debugName(device, shader.get(), "Shader Module \""+file+"\"");
         return std::move(shader);
     };
+
+    std::future<shader_map> createShaders(vk::Device device, std::vector<std::string> files)
+    {
+        return std::async(std::launch::async, [device, files](){
+            std::vector<std::future<vk::UniqueShaderModule>> futures;
+            for(const auto& file : files)
+                futures.push_back(std::async(std::launch::async, createShader, device, file));
+
+            shader_map shaders;
+            for(int i=0; i<files.size(); i++)
+                shaders[files[i]] = futures[i].get();
+            return shaders;
+        });
+    }
 }
@@ -3,17 +3,26 @@
 #include "config.hpp"
 
 #include "render/debug.hpp"
+#include "utils.hpp"
 
 #include <GLFW/glfw3.h>
 #include <spdlog/spdlog.h>
 
 #include <cxxabi.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <iterator>
 #include <map>
 #include <memory>
 #include <set>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 
 using namespace config;
 
@@ -58,6 +67,8 @@ namespace render
     {
         initWindow();
         initVulkan();
+
+        lastFPS = std::chrono::high_resolution_clock::now();
     }
 
     void window::initWindow()
@@ -106,7 +117,7 @@ namespace render
             .setApplicationVersion(constants::version)
             .setPEngineName(constants::name.c_str())
             .setEngineVersion(constants::version)
-            .setApplicationVersion(VK_VERSION_1_0);
+            .setApiVersion(VK_API_VERSION_1_2);
         auto const inst_info = vk::InstanceCreateInfo()
             .setPApplicationInfo(&app)
             .setPEnabledLayerNames(layers)
@@ -178,22 +189,82 @@ namespace render
                 .setPQueuePriorities(priorities.data());
         }
 
-        vk::PhysicalDeviceFeatures features = vk::PhysicalDeviceFeatures()
+        auto availableExtensions = physicalDevice.enumerateDeviceExtensionProperties();
+        auto extensionAvailable = [&availableExtensions](std::string_view name){
+            return std::any_of(availableExtensions.begin(), availableExtensions.end(), [name](const vk::ExtensionProperties& e){
+                return std::string_view(e.extensionName) == name;
+            });
+        };
+
+        // optional features are only enabled when supported, phases check deviceFeatures before relying on them
+        vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
+        vk::PhysicalDeviceVulkan12Features supportedFeatures12{};
+        vk::PhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+        vk::PhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+        bool vulkan12 = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+        bool presentWaitExtensions = vulkan12 &&
+            extensionAvailable(VK_KHR_PRESENT_ID_EXTENSION_NAME) && extensionAvailable(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        if(vulkan12)
+        {
+            vk::PhysicalDeviceFeatures2 features2{};
+            features2.pNext = &supportedFeatures12;
+            if(presentWaitExtensions)
+            {
+                supportedFeatures12.pNext = &supportedPresentId;
+                supportedPresentId.pNext = &supportedPresentWait;
+            }
+            physicalDevice.getFeatures2(&features2);
+            supportedFeatures12.pNext = nullptr;
+        }
+        presentWait = presentWaitExtensions && supportedPresentId.presentId && supportedPresentWait.presentWait;
+
+        deviceFeatures = vk::PhysicalDeviceFeatures()
             .setGeometryShader(true)
             .setSampleRateShading(true)
             .setFillModeNonSolid(true)
-            .setWideLines(true);
-        const std::vector<const char*> deviceExtensions = {
+            .setWideLines(true)
+            .setMultiDrawIndirect(supportedFeatures.multiDrawIndirect)
+            .setDrawIndirectFirstInstance(supportedFeatures.drawIndirectFirstInstance)
+            .setPipelineStatisticsQuery(supportedFeatures.pipelineStatisticsQuery)
+            .setInheritedQueries(supportedFeatures.inheritedQueries);
+        deviceFeatures12 = vk::PhysicalDeviceVulkan12Features()
+            .setDrawIndirectCount(supportedFeatures12.drawIndirectCount)
+            .setRuntimeDescriptorArray(supportedFeatures12.runtimeDescriptorArray)
+            .setShaderSampledImageArrayNonUniformIndexing(supportedFeatures12.shaderSampledImageArrayNonUniformIndexing)
+            .setDescriptorBindingPartiallyBound(supportedFeatures12.descriptorBindingPartiallyBound)
+            .setDescriptorBindingSampledImageUpdateAfterBind(supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind);
+        // present ids let the loop find out when a frame actually reached the screen
+        vk::PhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures(presentWait);
+        vk::PhysicalDevicePresentIdFeaturesKHR presentIdFeatures(presentWait, &presentWaitFeatures);
+        if(presentWait)
+            deviceFeatures12.pNext = &presentIdFeatures;
+        std::vector<const char*> deviceExtensions = {
             VK_KHR_SWAPCHAIN_EXTENSION_NAME
         };
+        for(const char* name : {VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME})
+        {
+            if(extensionAvailable(name))
+                deviceExtensions.push_back(name);
+        }
+        if(presentWait)
+        {
+            deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+        enabledDeviceExtensions.insert(deviceExtensions.begin(), deviceExtensions.end());
         vk::DeviceCreateInfo device_info = vk::DeviceCreateInfo()
+            .setPNext(vulkan12 ? &deviceFeatures12 : nullptr)
             .setQueueCreateInfos(queueInfos)
-            .setPEnabledFeatures(&features)
+            .setPEnabledFeatures(&deviceFeatures)
             .setPEnabledLayerNames(layers)
             .setPEnabledExtensionNames(deviceExtensions);
 
         device = physicalDevice.createDeviceUnique(device_info);
         VULKAN_HPP_DEFAULT_DISPATCHER.init(device.get());
+        deviceFeatures12.pNext = nullptr; // the present feature structs are gone after this function
+        if(!vulkan12)
+            spdlog::warn("Video device only supports Vulkan {}.{}, Vulkan 1.2 features are disabled",
+                VK_API_VERSION_MAJOR(deviceProperties.apiVersion), VK_API_VERSION_MINOR(deviceProperties.apiVersion));
         graphicsQueue = device->getQueue(queueFamilyIndices.graphicsFamily.value(), 0);
         presentQueue = device->getQueue(queueFamilyIndices.presentFamily.value(), 0);
         if(queueFamilyIndices.transferFamily.has_value())
@@ -206,17 +277,30 @@ namespace render
         }
         else
         {
-            transferQueues.push_back(graphicsQueue);
+            // the loader streams while frames are submitted, so it takes the other queues of the graphics family if there are any
+            int index = queueFamilyIndices.graphicsFamily.value();
+            for(int i=1; i<families[index].queueCount; i++)
+            {
+                transferQueues.push_back(device->getQueue(index, i));
+            }
+            if(transferQueues.empty())
+            {
+                spdlog::warn("The loader shares the graphics queue, its submits are serialized with the frames");
+                transferQueues.push_back(graphicsQueue);
+            }
         }
+        bool sharedQueue = std::find(transferQueues.begin(), transferQueues.end(), graphicsQueue) != transferQueues.end();
 
         vma::AllocatorCreateInfo allocator_info({}, physicalDevice, device.get());
         allocator_info.setInstance(instance.get());
         allocator = vma::createAllocator(allocator_info);
 
+        loadPipelineCache();
+
         loader = std::make_unique<resource_loader>(device.get(), allocator,
             queueFamilyIndices.transferFamily.value_or(queueFamilyIndices.graphicsFamily.value()),
             queueFamilyIndices.graphicsFamily.value(),
-            transferQueues);
+            transferQueues, sharedQueue ? &queueMutex : nullptr);
 
         auto formatIt = std::find_if(swapchainSupport.formats.begin(), swapchainSupport.formats.end(), [](auto f){
             return f.format == vk::Format::eB8G8R8A8Srgb && f.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
@@ -228,13 +312,16 @@ namespace render
         });
         swapchainPresentMode = presentModeIt == swapchainSupport.presentModes.end() ? swapchainSupport.presentModes[0] : *presentModeIt;
 
-        swapchainImageCount = swapchainSupport.capabilities.minImageCount + 1;
+        // every frame in flight needs an image to render into
+        swapchainImageCount = std::max(swapchainSupport.capabilities.minImageCount + 1, (uint32_t)std::max(CONFIG.framesInFlight, 1));
         if(swapchainSupport.capabilities.maxImageCount > 0)
             swapchainImageCount = std::min(swapchainImageCount, swapchainSupport.capabilities.maxImageCount);
+        framesInFlight = std::clamp(CONFIG.framesInFlight, 1, (int)swapchainImageCount);
 
-        spdlog::debug("Swapchain of format {}, present mode {}, extent {}x{} and {} images",
+        spdlog::debug("Swapchain of format {}, present mode {}, extent {}x{} and {} images, {} frame(s) in flight{}",
             vk::to_string(swapchainFormat.format), vk::to_string(swapchainPresentMode),
-            swapchainExtent.width, swapchainExtent.height, swapchainImageCount);
+            swapchainExtent.width, swapchainExtent.height, swapchainImageCount, framesInFlight,
+            presentWait ? ", present latency is measured" : "");
 
         vk::SwapchainCreateInfoKHR swapchain_info({}, surface.get(), swapchainImageCount,
             swapchainFormat.format, swapchainFormat.colorSpace,
@@ -270,33 +357,130 @@ namespace render
 #endif
     }
 
+    void window::set_loading_screen(phases::loading_screen* screen)
+    {
+        loadingScreen.reset(screen);
+
+        // done once, every following phase transition reuses the font and background
+        loadingScreen->preload();
+        loadingScreen->prepare(swapchainImages, swapchainImageViewsRaw);
+        loadingScreen->init();
+
+        spdlog::debug("Loading screen pipelines took {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(loadingScreen->getPipelineTime()).count());
+    }
+
     void window::set_phase(phase* renderer, entity::ticker* ticker)
     {
+        if(current_renderer)
+        {
+            std::scoped_lock<std::mutex> l(queueMutex);
+            device->waitIdle();
+            current_renderer.reset();
+        }
+        // input is not handled while loading, the old ticker might be gone already
+        glfwSetWindowUserPointer(win.get(), nullptr);
+        current_ticker.reset();
+
+        using clock = std::chrono::high_resolution_clock;
+        auto t0 = clock::now();
+        clock::time_point tPreload, tPrepare;
+        std::shared_future<void> loading = std::async(std::launch::async, [this, renderer, &tPreload, &tPrepare](){
+            renderer->preload();
+            tPreload = clock::now();
+            renderer->prepare(swapchainImages, swapchainImageViewsRaw);
+            tPrepare = clock::now();
+        }).share();
+
+        auto& type = typeid(*renderer);
+        char* name = abi::__cxa_demangle(type.name(), 0, 0, 0);
+
+        if(loadingScreen)
+        {
+            loadingScreen->reset();
+            loadingScreen->submitLoadingPoint({.name = "Preparing renderer", .future = loading});
+
+            // loadingFutures may only be looked at once preload is done, it's still filled in the background before
+            while(!glfwWindowShouldClose(win.get()) && (!utils::is_ready(loading) || !renderer->isLoaded()))
+            {
+                renderFrame(loadingScreen.get());
+            }
+            // the next phase renders into the same swapchain images
+            std::scoped_lock<std::mutex> l(queueMutex);
+            device->waitIdle();
+        }
+        loading.get();
+        renderer->waitLoad(); // only what a phase cannot render without, everything else streams in
+        auto tWaitLoad = clock::now();
+        renderer->init();
+        auto tInit = clock::now();
+
         current_renderer.reset(renderer);
         current_ticker.reset(ticker);
-
         current_ticker->init(this);
 
-        auto t0 = std::chrono::high_resolution_clock::now();
-        current_renderer->preload();
-        auto tPreload = std::chrono::high_resolution_clock::now();
-        current_renderer->prepare(swapchainImages, swapchainImageViewsRaw);
-        auto tPrepare = std::chrono::high_resolution_clock::now();
-        current_renderer->waitLoad(); // replace with loading screen
-        auto tWaitLoad = std::chrono::high_resolution_clock::now();
-        current_renderer->init();
-        auto tInit = std::chrono::high_resolution_clock::now();
-
         auto dPreload = std::chrono::duration_cast<std::chrono::milliseconds>(tPreload - t0).count();
         auto dPrepare = std::chrono::duration_cast<std::chrono::milliseconds>(tPrepare - tPreload).count();
         auto dWaitLoad = std::chrono::duration_cast<std::chrono::milliseconds>(tWaitLoad - tPrepare).count();
         auto dInit = std::chrono::duration_cast<std::chrono::milliseconds>(tInit - tWaitLoad).count();
         auto dTotal = std::chrono::duration_cast<std::chrono::milliseconds>(tInit - t0).count();
 
-        auto& type = typeid(*renderer);
-        char* name = abi::__cxa_demangle(type.name(), 0, 0, 0);
+        auto dPipelines = std::chrono::duration_cast<std::chrono::milliseconds>(renderer->getPipelineTime()).count();
 
-        spdlog::debug("Timing for phase \"{}\": preload/prepare/load/init/total: {}/{}/{}/{}/{} ms", name, dPreload, dPrepare, dWaitLoad, dInit, dTotal);
+        spdlog::debug("Timing for phase \"{}\": preload/prepare/load/init/total: {}/{}/{}/{}/{} ms, pipelines: {} ms", name, dPreload, dPrepare, dWaitLoad, dInit, dTotal, dPipelines);
+        std::free(name);
+    }
+
+    void window::loadPipelineCache()
+    {
+        std::vector<char> data;
+        if(!CONFIG.pipelineCacheFile.empty())
+        {
+            std::ifstream in(CONFIG.pipelineCacheFile, std::ios_base::binary | std::ios_base::ate);
+            if(in)
+            {
+                data.resize(in.tellg());
+                in.seekg(0);
+                in.read(data.data(), data.size());
+            }
+        }
+
+        // the driver would reject a foreign cache as well, but not necessarily without complaining
+        VkPipelineCacheHeaderVersionOne header{};
+        if(!data.empty())
+        {
+            bool valid = data.size() >= sizeof(header);
+            if(valid)
+            {
+                std::memcpy(&header, data.data(), sizeof(header));
+                valid = header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    header.vendorID == deviceProperties.vendorID &&
+                    header.deviceID == deviceProperties.deviceID &&
+                    std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+            }
+            if(!valid)
+            {
+                spdlog::info("Discarding pipeline cache \"{}\", it was created by a different device or driver", CONFIG.pipelineCacheFile);
+                data.clear();
+            }
+        }
+
+        pipelineCache = device->createPipelineCacheUnique(vk::PipelineCacheCreateInfo({}, data.size(), data.data()));
+        debugName(device.get(), pipelineCache.get(), "Pipeline Cache");
+        spdlog::debug("Created pipeline cache with {} KiB of initial data", data.size() / 1024);
+    }
+
+    void window::savePipelineCache()
+    {
+        if(CONFIG.pipelineCacheFile.empty())
+            return;
+
+        auto data = device->getPipelineCacheData(pipelineCache.get());
+        std::ofstream out(CONFIG.pipelineCacheFile, std::ios_base::binary | std::ios_base::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if(!out)
+            spdlog::warn("Failed to write pipeline cache to \"{}\"", CONFIG.pipelineCacheFile);
+        else
+            spdlog::debug("Wrote {} KiB of pipeline cache to \"{}\"", data.size() / 1024, CONFIG.pipelineCacheFile);
     }
 
     int window::rateDeviceSuitability(vk::PhysicalDevice phyDev)
@@ -347,65 +531,162 @@ namespace render
         return details;
     }
 
-    void window::loop()
+    uint32_t window::acquireFrame()
     {
-        lastFrame = std::chrono::high_resolution_clock::now();
-        lastFPS = std::chrono::high_resolution_clock::now();
-        framesInSecond = 0;
-
-        int currentFrame = 0;
-        vk::Result r;
-        while(!glfwWindowShouldClose(win.get()))
-        {
-            glfwPollEvents();
+        // presents that complete while this thread blocks are noticed right away, otherwise their latency would include the wait
+        vk::Result r = vk::Result::eTimeout;
+        while(!pendingPresents.empty() && (r = device->waitForFences(inFlightFences[currentFrame], true, 0)) == vk::Result::eTimeout)
+            pollPresents(presentPollInterval);
+        if(r == vk::Result::eTimeout)
+            r = device->waitForFences(inFlightFences[currentFrame], true, UINT64_MAX);
+        if(r != vk::Result::eSuccess)
+            spdlog::error("Waiting for inFlightFences[{}] failed with result {}", currentFrame, vk::to_string(r));
 
-            auto now = std::chrono::high_resolution_clock::now();
-            auto dt = std::chrono::duration<double>(now - lastFrame).count();
-            lastFrame = now;
-            current_ticker->tick(dt);
+        limitFrameRate();
 
-            r = device->waitForFences(inFlightFences[currentFrame], true, UINT64_MAX);
+        auto [result, imageIndex] = device->acquireNextImageKHR(swapchain.get(), UINT64_MAX, imageAvailableSemaphores[currentFrame].get());
+        if(imagesInFlight[imageIndex])
+        {
+            r = device->waitForFences(imagesInFlight[imageIndex], true, UINT64_MAX);
             if(r != vk::Result::eSuccess)
-                spdlog::error("Waiting for inFlightFences[{}] failed with result {}", currentFrame, vk::to_string(r));
-
-            auto [result, imageIndex] = device->acquireNextImageKHR(swapchain.get(), UINT64_MAX, imageAvailableSemaphores[currentFrame].get());
-            if(imagesInFlight[imageIndex])
-            {
-                r = device->waitForFences(imagesInFlight[imageIndex], true, UINT64_MAX);
-                if(r != vk::Result::eSuccess)
-                    spdlog::error("Waiting for imagesInFlight[{}] failed with result {}", imageIndex, vk::to_string(r));
-            }
-            imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+                spdlog::error("Waiting for imagesInFlight[{}] failed with result {}", imageIndex, vk::to_string(r));
+        }
+        imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-            device->resetFences(fences[currentFrame].get());
-            current_renderer->render(imageIndex, imageAvailableSemaphores[currentFrame].get(), renderFinishedSemaphores[currentFrame].get(), inFlightFences[currentFrame]);
+        pollPresents();
+        return imageIndex;
+    }
 
-            vk::PresentInfoKHR present_info(renderFinishedSemaphores[currentFrame].get(), swapchain.get(), imageIndex);
+    void window::submitFrame(phase* renderer, uint32_t imageIndex, std::chrono::high_resolution_clock::time_point inputTime)
+    {
+        device->resetFences(fences[currentFrame].get());
+        renderer->render(currentFrame, imageIndex, imageAvailableSemaphores[currentFrame].get(), renderFinishedSemaphores[currentFrame].get(), inFlightFences[currentFrame]);
+
+        vk::PresentInfoKHR present_info(renderFinishedSemaphores[currentFrame].get(), swapchain.get(), imageIndex);
+        uint64_t id = presentCount+1;
+        vk::PresentIdKHR present_id(1, &id);
+        if(presentWait)
+            present_info.setPNext(&present_id);
+        vk::Result r;
+        {
+            std::scoped_lock<std::mutex> l(queueMutex);
             r = presentQueue.presentKHR(present_info);
-            if(r != vk::Result::eSuccess)
-                spdlog::error("Present failed with result {}", vk::to_string(r));
+        }
+        if(r != vk::Result::eSuccess)
+            spdlog::error("Present failed with result {}", vk::to_string(r));
+        if(presentWait)
+        {
+            pendingPresents.push_back({++presentCount, inputTime});
+            // a present that never completes must not keep every later one around
+            if(pendingPresents.size() > maxPendingPresents)
+                pendingPresents.pop_front();
+        }
 
-            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % framesInFlight;
 
+        {
+            framesInSecond++;
+            auto t = std::chrono::high_resolution_clock::now();
+            using namespace std::chrono_literals;
+            if((t-lastFPS) > (1000ms/fpsSampleRate))
             {
-                framesInSecond++;
-                auto t = std::chrono::high_resolution_clock::now();
-                using namespace std::chrono_literals;
-                if((t-lastFPS) > (1000ms/fpsSampleRate))
+                currentFPS = framesInSecond / std::chrono::duration<double>(t-lastFPS).count();
+                lastFPS = t;
+                framesInSecond = 0;
+
+                if(fpsCount%fpsSampleRate == 0)
                 {
-                    currentFPS = framesInSecond / std::chrono::duration<double>(t-lastFPS).count();
-                    lastFPS = t;
-                    framesInSecond = 0;
-
-                    if(fpsCount%fpsSampleRate == 0)
-                    {
-                        spdlog::debug("{} FPS", currentFPS);
-                        fpsCount = 0;
-                    }
-                    fpsCount++;
+                    spdlog::debug("{} FPS", currentFPS);
+                    fpsCount = 0;
                 }
+                fpsCount++;
+            }
+        }
+    }
+
+    void window::renderFrame(phase* renderer)
+    {
+        uint32_t imageIndex = acquireFrame();
+        glfwPollEvents();
+        submitFrame(renderer, imageIndex, std::chrono::high_resolution_clock::now());
+    }
+
+    void window::limitFrameRate()
+    {
+        if(CONFIG.frameRateLimit <= 0.0)
+            return;
+
+        using clock = std::chrono::high_resolution_clock;
+        auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / CONFIG.frameRateLimit));
+        auto now = clock::now();
+        // after a long frame the limiter starts over instead of letting the following ones catch up
+        if(nextFrame < now - period)
+            nextFrame = now;
+
+        // the sleep is spent waiting for presents while there are any, that returns as soon as one completes
+        while(!pendingPresents.empty())
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(nextFrame - limiterSpin - clock::now());
+            if(remaining.count() <= 0)
+                break;
+            pollPresents(remaining.count());
+        }
+        now = clock::now();
+
+        // the scheduler may wake up late, so the last part is spun away
+        if(nextFrame - now > limiterSpin)
+            std::this_thread::sleep_until(nextFrame - limiterSpin);
+        while(clock::now() < nextFrame)
+            std::this_thread::yield();
+        nextFrame += period;
+    }
+
+    void window::pollPresents(uint64_t timeout)
+    {
+        // presents complete in order, so only the oldest ones have to be checked
+        while(!pendingPresents.empty())
+        {
+            auto [id, inputTime] = pendingPresents.front();
+            vk::Result r;
+            try
+            {
+                r = device->waitForPresentKHR(swapchain.get(), id, timeout);
+            }
+            catch(const vk::SystemError& e)
+            {
+                spdlog::warn("Waiting for present {} failed: {}", id, e.what());
+                pendingPresents.clear();
+                break;
             }
+            if(r == vk::Result::eTimeout)
+                break;
+            pendingPresents.pop_front();
+            timeout = 0;
+
+            // only noticed here, so this is late by up to the time since the last check
+            double latency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - inputTime).count();
+            presentLatency = presentLatency > 0.0 ? std::lerp(presentLatency, latency, 0.1) : latency;
         }
+    }
+
+    void window::loop()
+    {
+        lastFrame = std::chrono::high_resolution_clock::now();
+
+        while(!glfwWindowShouldClose(win.get()))
+        {
+            // input is sampled after everything that might block, so the frame shows the latest state when it is recorded
+            uint32_t imageIndex = acquireFrame();
+            glfwPollEvents();
+
+            auto now = std::chrono::high_resolution_clock::now();
+            auto dt = std::chrono::duration<double>(now - lastFrame).count();
+            lastFrame = now;
+            current_ticker->tick(dt);
+
+            submitFrame(current_renderer.get(), imageIndex, now);
+        }
+        std::scoped_lock<std::mutex> l(queueMutex);
         graphicsQueue.waitIdle();
         presentQueue.waitIdle();
     }
@@ -416,6 +697,22 @@ namespace render
 
         current_renderer.reset();
         current_ticker.reset();
+        loadingScreen.reset();
+
+        savePipelineCache();
+
+        {
+            auto stats = loader->statistics();
+            spdlog::info("Resource loader: {} of {} task(s) ({} failed), {} KiB uploaded at {} MiB/s, latency p50/p99: {}/{} ms",
+                stats.tasksCompleted, stats.tasksQueued, stats.tasksFailed, stats.uploadBytes / 1024, stats.throughput,
+                std::chrono::duration_cast<std::chrono::milliseconds>(stats.p50Latency).count(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(stats.p99Latency).count());
+            if(!CONFIG.loaderStatisticsFile.empty())
+            {
+                std::ofstream out(CONFIG.loaderStatisticsFile);
+                loader->writeStatistics(out);
+            }
+        }
         loader.reset();
 
         allocator.destroy();